@@ -0,0 +1,127 @@
+#include <stddef.h>
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* A ready queue for fixed priorities, where every operation is in
+   constant time, whatever the number of tasks:
+
+   - There is one FIFO of contexts per priority level, doubly linked
+     through sched_context.next and prev. Tasks with the same priority
+     are thus executed round-robin.
+
+   - A two-level bitmap tells which FIFOs are non-empty: bit i of
+     summary is set iff words[i] is non-zero, and bit j of words[i] is
+     set iff the FIFO for priority 32 * i + j is non-empty. Finding
+     the highest priority is thus two bit scans (bsr on x86).
+
+   Higher numbers mean higher priorities. */
+
+#define BITMAP_QUEUE_WORDS ((NB_PRIORITIES + 31)/32)
+_Static_assert(BITMAP_QUEUE_WORDS <= 32,
+               "NB_PRIORITIES must be at most 1024 for a two-level bitmap");
+
+struct bitmap_queue {
+  uint32_t summary;
+  uint32_t words[BITMAP_QUEUE_WORDS];
+  struct bitmap_queue_fifo {
+    struct context *head;
+    struct context *tail;
+  } fifo[NB_PRIORITIES];
+};
+
+/* Index of the most significant bit set; x must not be 0. GCC
+   compiles this to a single bsr instruction. */
+static inline unsigned int bitmap_queue_msb(uint32_t x){
+  return 31 - __builtin_clz(x);
+}
+
+static inline _Bool bitmap_queue_is_empty(struct bitmap_queue const *q){
+  return q->summary == 0;
+}
+
+/* The queue must not be empty. */
+static inline unsigned int bitmap_queue_top_priority(struct bitmap_queue const *q){
+  unsigned int i = bitmap_queue_msb(q->summary);
+  return 32 * i + bitmap_queue_msb(q->words[i]);
+}
+
+static inline void bitmap_queue_mark(struct bitmap_queue *q, unsigned int prio){
+  q->words[prio / 32] |= 1U << (prio % 32);
+  q->summary |= 1U << (prio / 32);
+}
+
+static inline void bitmap_queue_unmark(struct bitmap_queue *q, unsigned int prio){
+  q->words[prio / 32] &= ~(1U << (prio % 32));
+  if(q->words[prio / 32] == 0)
+    q->summary &= ~(1U << (prio / 32));
+}
+
+/* Insert at the end of the FIFO for its priority. */
+static inline void bitmap_queue_push_back(struct bitmap_queue *q, struct context *ctx){
+  unsigned int prio = ctx->sched_context.priority;
+  assert(prio < NB_PRIORITIES);
+  struct bitmap_queue_fifo *f = &q->fifo[prio];
+  ctx->sched_context.next = NULL;
+  if(f->head == NULL){
+    ctx->sched_context.prev = NULL;
+    f->head = ctx;
+    bitmap_queue_mark(q, prio);
+  }
+  else {
+    ctx->sched_context.prev = f->tail;
+    f->tail->sched_context.next = ctx;
+  }
+  f->tail = ctx;
+}
+
+/* Insert at the beginning of the FIFO, e.g. for a preempted task
+   which should resume before the others of the same priority. */
+static inline void bitmap_queue_push_front(struct bitmap_queue *q, struct context *ctx){
+  unsigned int prio = ctx->sched_context.priority;
+  assert(prio < NB_PRIORITIES);
+  struct bitmap_queue_fifo *f = &q->fifo[prio];
+  ctx->sched_context.next = f->head;
+  ctx->sched_context.prev = NULL;
+  if(f->head == NULL){
+    f->tail = ctx;
+    bitmap_queue_mark(q, prio);
+  }
+  else f->head->sched_context.prev = ctx;
+  f->head = ctx;
+}
+
+/* Remove the first context with the highest priority. The queue must
+   not be empty. */
+static inline struct context *bitmap_queue_pop(struct bitmap_queue *q){
+  unsigned int prio = bitmap_queue_top_priority(q);
+  struct bitmap_queue_fifo *f = &q->fifo[prio];
+  struct context *ctx = f->head;
+  f->head = ctx->sched_context.next;
+  if(f->head == NULL) bitmap_queue_unmark(q, prio);
+  else f->head->sched_context.prev = NULL;
+  return ctx;
+}
+
+/* Remove ctx if it is in the queue. Return true if it was. Only
+   the first context of a FIFO has no prev. */
+static inline _Bool bitmap_queue_remove(struct bitmap_queue *q, struct context *ctx){
+  unsigned int prio = ctx->sched_context.priority;
+  struct bitmap_queue_fifo *f = &q->fifo[prio];
+  struct context *prev = ctx->sched_context.prev;
+  struct context *next = ctx->sched_context.next;
+  if(prev == NULL && f->head != ctx) return 0;
+  if(prev == NULL) f->head = next;
+  else prev->sched_context.next = next;
+  if(next == NULL) f->tail = prev;
+  else next->sched_context.prev = prev;
+  ctx->sched_context.prev = NULL;
+  if(f->head == NULL) bitmap_queue_unmark(q, prio);
+  return 1;
+}
+
+static inline void bitmap_queue_init(struct bitmap_queue *q){
+  q->summary = 0;
+  for(unsigned int i = 0; i < BITMAP_QUEUE_WORDS; i++) q->words[i] = 0;
+  for(unsigned int i = 0; i < NB_PRIORITIES; i++) q->fifo[i].head = NULL;
+}
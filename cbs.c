@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* Constant Bandwidth Servers for EDF_SCHEDULING. A task with a
+   reservation (budget Q, period T) is scheduled by EDF using the
+   deadline of its server instead of the one it passes to yield, and
+   cannot get more than Q every T:
+
+   - the execution time of the running task is charged to its server
+     on each timer interrupt and on each yield; the timer is also armed
+     for the date at which the budget runs out.
+
+   - when the budget is exhausted, it is recharged to Q and the server
+     deadline is postponed by T, so that the task gets preempted by
+     more urgent ones.
+
+   - when the task wakes at date r, if the remaining budget c is too
+     large to be used before the server deadline d without exceeding
+     the bandwidth (c >= (d - r) Q/T), the server starts afresh with
+     deadline r + T and budget Q.
+
+   Tasks with no reservation (Q = 0) are scheduled with their own
+   deadline, and are not charged. priority_scheduler.c includes this
+   file. */
+
+#ifdef CBS_RESERVATIONS
+
+/* The context whose execution time is being charged, or NULL. */
+static struct context *cbs_running;
+
+static inline _Bool cbs_reserved(struct context const *ctx){
+  return ctx->sched_context.cbs_budget != 0;
+}
+
+/* Charge the time elapsed since ctx started to run. */
+static inline void cbs_charge(struct context *ctx, date_t now){
+  struct scheduling_context *s = &ctx->sched_context;
+  if(!cbs_reserved(ctx)) return;
+  duration_t used = now - s->cbs_start;
+  s->cbs_start = now;
+  /* Because of the tick granularity, the overrun may exceed the
+     budget. */
+  while(used >= s->cbs_remaining){
+    used -= s->cbs_remaining;
+    s->cbs_remaining = s->cbs_budget;
+    s->cbs_deadline += s->cbs_period;
+  }
+  s->cbs_remaining -= used;
+}
+
+/* To be called when ctx wakes. The arrival date is its wakeup_date. */
+static inline void cbs_release(struct context *ctx){
+  struct scheduling_context *s = &ctx->sched_context;
+  if(!cbs_reserved(ctx)){
+    s->cbs_deadline = s->deadline;
+    return;
+  }
+  date_t const r = s->wakeup_date;
+  if(s->cbs_deadline <= r
+     || s->cbs_remaining * s->cbs_period >= (s->cbs_deadline - r) * s->cbs_budget){
+    s->cbs_deadline = r + s->cbs_period;
+    s->cbs_remaining = s->cbs_budget;
+  }
+}
+
+/* To be called on each timer interrupt, before the preemption check. */
+static inline void cbs_tick(date_t curtime){
+  if(cbs_running) cbs_charge(cbs_running, curtime);
+}
+
+/* To be called when the running ctx yields. */
+static inline void cbs_stop(struct context *ctx){
+  cbs_charge(ctx, timer_current_time());
+  cbs_running = NULL;
+}
+
+/* To be called when ctx (maybe idle) is chosen to run. Returns
+   true if the timer must be rearmed for the end of its budget. */
+static inline _Bool cbs_dispatch(struct context *ctx){
+  cbs_running = ctx;
+  if(ctx == NULL || !cbs_reserved(ctx)) return 0;
+  ctx->sched_context.cbs_start = timer_current_time();
+  return 1;
+}
+
+/* The date at which the timer should wake, given that the scheduler
+   wants to wake at next. */
+static inline date_t cbs_next_event(date_t next){
+  struct context *ctx = cbs_running;
+  if(ctx == NULL || !cbs_reserved(ctx)) return next;
+  date_t const exhausted = ctx->sched_context.cbs_start + ctx->sched_context.cbs_remaining;
+  if(exhausted < next) return exhausted;
+  return next;
+}
+
+static inline void cbs_init(void){
+  date_t const now = timer_current_time();
+  cbs_running = NULL;
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    struct task_description const *task = &user_tasks_image.tasks[i];
+    struct scheduling_context *s = &task->context->sched_context;
+    if(task->cbs_budget > task->cbs_period)
+      fatal("The reservation of task %d exceeds its period\n", i);
+    s->cbs_budget = task->cbs_budget;
+    s->cbs_period = task->cbs_period;
+    s->cbs_remaining = task->cbs_budget;
+    s->cbs_deadline = task->cbs_budget ? now + task->cbs_period : s->deadline;
+  }
+}
+
+#else
+
+static inline void cbs_release(struct context *ctx){ (void) ctx; }
+static inline void cbs_tick(date_t curtime){ (void) curtime; }
+static inline void cbs_stop(struct context *ctx){ (void) ctx; }
+static inline _Bool cbs_dispatch(struct context *ctx){ (void) ctx; return 0; }
+static inline date_t cbs_next_event(date_t next){ return next; }
+static inline void cbs_init(void){}
+
+#endif /* CBS_RESERVATIONS */
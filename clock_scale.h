@@ -0,0 +1,26 @@
+#ifndef __CLOCK_SCALE_H__
+#define __CLOCK_SCALE_H__
+
+/* Conversions between the counters of the timers and nanoseconds, in
+   fixed point: x * mult >> shift, without division. */
+
+#include <stdint.h>
+
+struct scale { uint32_t mult; unsigned int shift; };
+
+/* The most precise conversion multiplying by num/den. */
+static inline struct scale scale_init(uint64_t num, uint64_t den){
+  unsigned int shift = 32;
+  while(shift > 0 && (num > (~0ULL >> shift) || (num << shift) / den > 0xFFFFFFFFULL))
+    shift--;
+  return (struct scale){ .mult = (num << shift) / den, .shift = shift };
+}
+
+/* Without overflow, if the result fits. */
+static inline uint64_t scale(uint64_t x, struct scale s){
+  uint64_t const hi = (x >> 32) * s.mult;
+  uint64_t const lo = (x & 0xFFFFFFFFULL) * s.mult;
+  return (hi << (32 - s.shift)) + (lo >> s.shift);
+}
+
+#endif
@@ -14,23 +14,184 @@
    code descriptors are written once at boot time. */
 #define NUM_CPUS 1
 
+/* If set, the PIT is not programmed with a periodic tick, but in
+   one-shot mode, to interrupt exactly at the date given to
+   timer_wake_at (see pit_timer.c). Dates far away are reached with a
+   chain of the longest shots, about 55ms. */
+/* #define TIMER_TICKLESS */
 
-//#define DEADLINE_MONITORING
-#if defined(DEADLINE_MONITORING)
-#error "Not yet implemented"
+/* If set, the IRQs of the PIT and HPET timers are not delivered by
+   the 8259, which is masked, but by the IOAPIC and the local APIC
+   (see x86/irq.h). The end of interrupt is then a memory write
+   instead of a port I/O. The interrupt priority is not changed with
+   the task priority register (see lapic_enable). */
+/* #define IOAPIC_INTERRUPTS */
+
+/* With the periodic PIT, the ticks that wake nothing are handled by a
+   fast path in assembly (see pit_timer.c). */
+#if defined(PIT_TIMER) && !defined(TIMER_TICKLESS) && NUM_CPUS == 1
+#define TIMER_FAST_PATH
 #endif
 
+
+/* If set, the kernel checks that each job completes before the
+   deadline given to yield. A miss is detected at the timer interrupt,
+   counted in the scheduling context of the task, and logged on the
+   terminal; then DEADLINE_OVERRUN_POLICY is applied to the late
+   task. */
+//#define DEADLINE_MONITORING
+#define DEADLINE_OVERRUN_LOG 0    /* Nothing else; the job continues. */
+#define DEADLINE_OVERRUN_SKIP 1   /* The next job of the task is skipped. */
+#define DEADLINE_OVERRUN_DEMOTE 2 /* The job continues at the lowest priority. */
+#define DEADLINE_OVERRUN_POLICY DEADLINE_OVERRUN_LOG
+
 /* #define FP_SCHEDULING */
 /* #define EDF_SCHEDULING */
 /* #define ROUND_ROBIN_SCHEDULING */
+/* CYCLIC_SCHEDULING follows a dispatch table computed offline by
+   system_desc_gen, from the period, offset and WCET of the tasks. */
+/* #define CYCLIC_SCHEDULING */
+/* STRIDE_SCHEDULING shares the processor in proportion of the tickets
+   of the tasks. */
+/* #define STRIDE_SCHEDULING */
 
-#if !defined(FP_SCHEDULING) && !defined(EDF_SCHEDULING) && !defined(ROUND_ROBIN_SCHEDULING)
+#if !defined(FP_SCHEDULING) && !defined(EDF_SCHEDULING) && !defined(ROUND_ROBIN_SCHEDULING) \
+  && !defined(CYCLIC_SCHEDULING) && !defined(STRIDE_SCHEDULING)
 #error "Must define one scheduler"
 #endif
 
-#if defined(FP_SCHEDULING) && defined(EDF_SCHEDULING)
-||  defined(FP_SCHEDULING) && defined(ROUND_ROBIN_SCHEDULING)
-||  defined(EDF_SCHEDULING) && defined(ROUND_ROBIN_SCHEDULING)  
+#if defined(CYCLIC_SCHEDULING) && (defined(TIME_PARTITIONING) || defined(DEADLINE_MONITORING))
+#error "CYCLIC_SCHEDULING is checked offline, and does not support TIME_PARTITIONING or DEADLINE_MONITORING"
+#endif
+
+/* If set, FP_SCHEDULING uses a ready queue with one FIFO per priority
+   and a priority bitmap instead of a heap: all the operations are in
+   constant time, and tasks with the same priority are executed
+   round-robin. Priorities must be smaller than NB_PRIORITIES. */
+/* #define READY_QUEUE_BITMAP */
+#define NB_PRIORITIES 256
+
+#if defined(READY_QUEUE_BITMAP) && !defined(FP_SCHEDULING)
+#error "READY_QUEUE_BITMAP requires FP_SCHEDULING"
+#endif
+
+/* If set, the tasks are run-to-completion "basic" tasks (as in OSEK):
+   each job starts afresh at the entry point of the task, and ends with
+   job_end; the next job is released one period later. The tasks of
+   the same preemption level (priority) and partition can share an
+   image, and thus its stack, as in the Stack Resource Policy: this
+   requires that a preempted job resumes before the other jobs of its
+   level start, which READY_QUEUE_BITMAP ensures. Only the image and
+   the stack are shared: each task keeps its context, and a job starts
+   with iret like any other switch, as the kernel cannot call into the
+   ring 3 segments of the tasks. */
+/* #define BASIC_TASKS */
+
+#if defined(BASIC_TASKS) && !defined(READY_QUEUE_BITMAP)
+#error "BASIC_TASKS requires READY_QUEUE_BITMAP"
+#endif
+#if defined(BASIC_TASKS) && DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+#error "BASIC_TASKS cannot change the preemption level of a job"
+#endif
+
+/* If set, EDF_SCHEDULING enforces the (budget, period) reservations
+   of the tasks with Constant Bandwidth Servers (see cbs.c): a task
+   gets at most its budget every period, whatever the deadlines it
+   claims. */
+/* #define CBS_RESERVATIONS */
+
+#if defined(CBS_RESERVATIONS) && !defined(EDF_SCHEDULING)
+#error "CBS_RESERVATIONS requires EDF_SCHEDULING"
+#endif
+#if defined(CBS_RESERVATIONS) && DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+#error "CBS_RESERVATIONS already postpones the late tasks; use another overrun policy"
+#endif
+
+/* If set, the tasks can synchronize with the mutexes of the system
+   description (see mutex.c). The mutexes are words in a segment
+   shared by all the tasks, accessed through %gs: taking or releasing
+   a free mutex is a single atomic instruction in user space. Only
+   contention calls the kernel, which blocks the caller and applies
+   priority inheritance. */
+/* #define MUTEXES */
+
+#if defined(MUTEXES) && !defined(FP_SCHEDULING) && !defined(EDF_SCHEDULING)
+#error "MUTEXES requires FP_SCHEDULING or EDF_SCHEDULING"
+#endif
+#if defined(MUTEXES) && defined(BASIC_TASKS)
+#error "BASIC_TASKS share stacks, and cannot block on a mutex"
+#endif
+#if defined(MUTEXES) && (defined(CBS_RESERVATIONS) || DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE)
+#error "MUTEXES does not support other changes of the priority of a task"
+#endif
+
+/* If set, a task can be bound to an IRQ line in the system
+   description, and drive its device from user space: it blocks in
+   wait_irq, and the interrupt makes it ready at its own priority
+   (see user_irq.c). */
+/* #define USER_INTERRUPTS */
+
+#if defined(USER_INTERRUPTS) && !defined(FP_SCHEDULING) && !defined(EDF_SCHEDULING)
+#error "USER_INTERRUPTS requires FP_SCHEDULING or EDF_SCHEDULING"
+#endif
+#if defined(USER_INTERRUPTS) && defined(BASIC_TASKS)
+#error "BASIC_TASKS share stacks, and cannot block waiting for an interrupt"
+#endif
+
+/* If set, a task can use in and out directly on the I/O ports listed
+   in its description; the others fault. The TSS of each processor
+   carries an I/O permission bitmap, updated when the processor
+   switches to a task with another list. */
+/* #define USER_IO_PORTS */
+
+/* If set, the syscall wrappers enter the kernel with SYSENTER rather
+   than int 0x27, which avoids the interrupt gate and the TSS stack
+   switch. Each task tests whether the processor supports it, and
+   uses int 0x27 otherwise. The kernel returns with iret, as SYSEXIT
+   would load flat user segments. */
+/* #define SYSENTER_SYSCALLS */
+
+/* If set, the tasks can use the x87 and SSE registers, saved with
+   fxsave. The switch is lazy: CR0.TS is set when a task does not own
+   the FPU, and its first FPU instruction raises #NM, which saves the
+   state of the previous owner and restores its own. The kernel itself
+   must not use the FPU. */
+/* #define FPU_CONTEXT */
+
+/* If set, the schedulers keep the waiting tasks in a hierarchical
+   timing wheel instead of a heap: insertion is in O(1), and all the
+   tasks that wake on the same tick are expired at once. */
+/* #define WAITING_TIMING_WHEEL */
+
+/* If set, the heaps of the kernel (ready, waiting and deadline
+   monitor) are d-ary heaps of this arity, which keep the priority of
+   each context next to it (see INSTANTIATE_DARY_HEAP in heap.c, and
+   make bench to compare them with the binary heap). The children of
+   a node must fit in a cache line of DARY_HEAP_CACHE_LINE bytes: with
+   dates as priorities, the arity is at most 4. */
+/* #define HEAP_ARITY 4 */
+#define DARY_HEAP_CACHE_LINE 64
+
+/* With ROUND_ROBIN_SCHEDULING, the maximum time (in nanoseconds) that
+   a task can run when other tasks are ready. */
+#define RR_QUANTUM (10ULL * 1000 * 1000)
+
+/* With STRIDE_SCHEDULING, the quantum (in nanoseconds) for which the
+   pass of a task is advanced by its stride. */
+#define STRIDE_QUANTUM (10ULL * 1000 * 1000)
+
+/* If set, the tasks are grouped in partitions which execute in fixed
+   windows of a repeating major frame (ARINC 653-style time
+   partitioning). The windows are given in the system description. */
+/* #define TIME_PARTITIONING */
+#ifdef TIME_PARTITIONING
+#define MAX_PARTITIONS 8
+#else
+#define MAX_PARTITIONS 1
+#endif
+
+#if defined(FP_SCHEDULING) + defined(EDF_SCHEDULING) + defined(ROUND_ROBIN_SCHEDULING) \
+  + defined(CYCLIC_SCHEDULING) + defined(STRIDE_SCHEDULING) > 1
 #error "Cannot define two schedulers simultaneously"
 #endif
 
@@ -2,4 +2,22 @@
 
 # SCHEDULER=EDF_SCHEDULING
 # SCHEDULER=FP_SCHEDULING
+# SCHEDULER=CYCLIC_SCHEDULING
+# SCHEDULER=STRIDE_SCHEDULING
 SCHEDULER=ROUND_ROBIN_SCHEDULING
+
+# Timer. PIT_TIMER uses the 8254 PIT (see also TIMER_TICKLESS in
+# config.h); TSC_APIC_TIMER uses the TSC and the local APIC timer;
+# HPET_TIMER uses the HPET.
+TIMER=PIT_TIMER
+# TIMER=TSC_APIC_TIMER
+# TIMER=HPET_TIMER
+
+# Number of partitions in the generated system descriptions (used
+# with -DTIME_PARTITIONING).
+PARTITIONS=1
+
+# Task set of the generated system descriptions: one task per line,
+# "period wcet [deadline [priority]]" in microseconds (see
+# system_desc_gen.ml). The default one is used if empty.
+TASKSET=
@@ -0,0 +1,82 @@
+#include <stddef.h>
+#include "scheduler.h"
+#include "user_tasks.h"
+#include "high_level.h"
+#include "per_cpu.h"
+#include "error.h"
+
+/* Cyclic executive: the schedule of one hyperperiod is computed
+   offline by system_desc_gen, and given as a dispatch table. Each
+   timer event moves to the next entry of the table, whose task
+   executes until the date of the following entry. A task that
+   completes its job early (its wakeup_date is after the start of the
+   entry) leaves the processor to the idle context. There is no
+   decision to take online, so no ready or waiting queue. */
+
+static struct {
+  /* The current entry. */
+  unsigned int index;
+  /* Start of the current hyperperiod. */
+  date_t frame_start;
+  /* Start and end of the current entry. */
+  date_t entry_start;
+  date_t entry_end;
+} cyclic_state;
+
+static inline void cyclic_enter(unsigned int index){
+  struct dispatch_entry const *table = user_tasks_image.dispatch_table;
+  cyclic_state.index = index;
+  cyclic_state.entry_start = cyclic_state.frame_start + table[index].date;
+  /* The table ends with an entry dated hyperperiod. */
+  cyclic_state.entry_end = cyclic_state.frame_start + table[index + 1].date;
+}
+
+/* The task will run again in its next entry; the timer is already
+   armed for the end of the current one. */
+void sched_set_waiting(struct context *ctx){
+  (void) ctx;
+}
+
+/* Normally called once per entry; the loop only catches up if the
+   timer was late. */
+void sched_wake_tasks(date_t curtime){
+  while(curtime >= cyclic_state.entry_end){
+    unsigned int index = cyclic_state.index + 1;
+    if(index == user_tasks_image.nb_dispatch){
+      index = 0;
+      cyclic_state.frame_start += user_tasks_image.hyperperiod;
+    }
+    cyclic_enter(index);
+  }
+  timer_wake_at(cyclic_state.entry_end);
+}
+
+struct context *sched_choose_next(void){
+  struct context *ctx = user_tasks_image.dispatch_table[cyclic_state.index].context;
+  if(ctx == NULL || ctx->sched_context.wakeup_date > cyclic_state.entry_start)
+    return &user_tasks_image.idle_ctx_array[current_cpu()];
+  return ctx;
+}
+
+/* The table decides: the current context is preempted at the end of
+   its entry. */
+struct context *sched_maybe_preempt(struct context *ctx){
+  assert(ctx != &user_tasks_image.idle_ctx_array[current_cpu()]);
+  return sched_choose_next();
+}
+
+void scheduler_init(void){
+  unsigned int const nb_tasks = NB_USER_TASKS;
+
+  if(user_tasks_image.nb_dispatch == 0) fatal("Empty dispatch table\n");
+
+  cyclic_state.frame_start = timer_current_time();
+  cyclic_enter(0);
+  timer_wake_at(cyclic_state.entry_end);
+
+  /* The first job of each task is released at its offset. */
+  for(unsigned int i = 0; i < nb_tasks; i++){
+    struct task_description const *task = &user_tasks_image.tasks[i];
+    task->context->sched_context.wakeup_date = cyclic_state.frame_start + task->offset;
+  }
+}
@@ -0,0 +1,147 @@
+#include "user_tasks.h"
+#include "high_level.h"
+#include "terminal.h"
+#include "error.h"
+
+/* Deadline monitoring: check that each job completes (i.e. yields)
+   before its deadline.
+
+   A job starts when its task wakes, with the deadline given by the
+   previous yield. Pending jobs are kept in a heap sorted by deadline,
+   and the timer is also armed for the earliest deadline, so that a
+   miss is detected by the timer interrupt, even if the task never
+   yields. The misses and the worst lateness (date of completion minus
+   deadline) are counted in the scheduling context of the task, and
+   each miss is logged; then DEADLINE_OVERRUN_POLICY is applied.
+
+   The first job of each task has no deadline, and is not monitored.
+
+   The schedulers include this file after heap.c. With the
+   DEADLINE_OVERRUN_DEMOTE policy, the includer must provide
+   demote_task(ctx), which lowers the priority of the late task until
+   the end of its job, and restore_task(ctx), called when the job
+   completes. */
+
+#ifdef DEADLINE_MONITORING
+
+enum deadline_state { DEADLINE_NONE, DEADLINE_PENDING, DEADLINE_MISSED };
+
+typedef date_t monitor_priority_t;
+typedef struct context * monitor_elt_id_t;
+static monitor_priority_t monitor_get_priority(monitor_elt_id_t ctx){
+  return ctx->sched_context.job_deadline;
+}
+/* Earlier deadlines have higher priority. */
+static _Bool monitor_is_gt_priority(date_t a, date_t b){
+  return a < b;
+}
+/* A pending job can also be in the ready heap, so it has its own index. */
+static void monitor_set_index(monitor_elt_id_t ctx, unsigned int index){
+  ctx->sched_context.monitor_index = index;
+}
+static unsigned int monitor_get_index(monitor_elt_id_t ctx){
+  return ctx->sched_context.monitor_index;
+}
+#ifdef HEAP_ARITY
+INSTANTIATE_DARY_HEAP(monitor, HEAP_ARITY);
+_Static_assert(sizeof(struct monitor_heap_entry) <= HEAP_ENTRY_MAX, "See HEAP_STORAGE");
+/* Defined by HIGH_LEVEL_SYSTEM_DESC. */
+extern char deadline_heap_storage[];
+#else
+INSTANTIATE_HEAP(monitor);
+/* Defined by HIGH_LEVEL_SYSTEM_DESC. */
+extern struct context *deadline_heap_array[];
+#endif
+static struct monitor_heap monitor_heap;
+
+static inline unsigned int deadline_task_index(struct context const *ctx){
+  return context_index(ctx);
+}
+
+/* Count a miss of the current job of ctx, and log it. */
+static inline void deadline_count_miss(struct context *ctx){
+  struct scheduling_context *s = &ctx->sched_context;
+  s->deadline_state = DEADLINE_MISSED;
+  s->deadline_misses++;
+  terminal_print("Task %d missed its deadline (%d misses)\n",
+                 deadline_task_index(ctx), s->deadline_misses);
+}
+
+/* To be called when ctx wakes: start monitoring its new job. */
+static inline void deadline_release(struct context *ctx){
+  struct scheduling_context *s = &ctx->sched_context;
+  s->job_release = s->wakeup_date;
+  s->job_deadline = s->deadline;
+  s->deadline_state = DEADLINE_PENDING;
+  monitor_insert_elt(&monitor_heap, ctx);
+}
+
+static void deadline_miss(struct context *ctx){
+  deadline_count_miss(ctx);
+#if DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+  demote_task(ctx);
+#endif
+}
+
+/* Detect the jobs whose deadline has passed. Called on the timer
+   interrupt, before the preemption check. */
+static inline void deadline_check(date_t curtime){
+  monitor_remove_up_to(&monitor_heap, curtime, deadline_miss);
+}
+
+/* To be called when the job of ctx completes, before ctx is set as
+   waiting; its next wakeup_date and deadline have already been set. */
+static inline void deadline_job_end(struct context *ctx){
+  struct scheduling_context *s = &ctx->sched_context;
+  if(s->deadline_state == DEADLINE_NONE) return;
+  date_t const now = timer_current_time();
+  if(s->deadline_state == DEADLINE_PENDING){
+    monitor_remove_handle(&monitor_heap, ctx);
+    /* The job may have completed late before the timer noticed. */
+    if(now <= s->job_deadline){
+      s->deadline_state = DEADLINE_NONE;
+      return;
+    }
+    deadline_count_miss(ctx);
+  }
+  duration_t const lateness = now - s->job_deadline;
+  if(lateness > s->worst_lateness) s->worst_lateness = lateness;
+  s->deadline_state = DEADLINE_NONE;
+#if DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_SKIP
+  /* Skip the next job: release the task one period later. */
+  duration_t const period = s->wakeup_date - s->job_release;
+  s->wakeup_date += period;
+  s->deadline += period;
+#elif DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+  restore_task(ctx);
+#endif
+}
+
+/* The date at which the timer should wake, given that the scheduler
+   wants to wake at next. */
+static inline date_t deadline_next_event(date_t next){
+  if(monitor_heap.size == 0) return next;
+  date_t const deadline = monitor_top_priority(&monitor_heap);
+  if(deadline < next) return deadline;
+  return next;
+}
+
+static inline void deadline_init(void){
+  monitor_heap.size = 0;
+  monitor_heap.capacity = NB_USER_TASKS;
+#ifdef HEAP_ARITY
+  monitor_heap.array = DARY_HEAP_ARRAY_IN(monitor, deadline_heap_storage);
+#else
+  monitor_heap.array = deadline_heap_array;
+#endif
+}
+
+#else
+
+static inline void deadline_release(struct context *ctx){ (void) ctx; }
+static inline void deadline_check(date_t curtime){ (void) curtime; }
+static inline void deadline_job_end(struct context *ctx){ (void) ctx; }
+static inline date_t deadline_next_event(date_t next){ return next; }
+static inline void deadline_init(void){}
+
+#endif /* DEADLINE_MONITORING */
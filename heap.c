@@ -1,5 +1,3 @@
-#include "user_tasks.h"
-
 /* What we do here is a kind of OCaml functor for C. It takes as argment
    (that must be defined earlier, possibly as static inline)
 
@@ -8,176 +6,428 @@
      involve more copies).
    - A prefix_priority_t type (e.g. an int).
    - A function to get the priorities of an element (prefix_get_priority)
-   - A function to compare the priorities (prefix_is_gt_priority): > for max_heap, < for min_heap. */
+   - A function to compare the priorities (prefix_is_gt_priority): > for max_heap, < for min_heap.
+   - Functions to store and retrieve the position of an element in
+     the array (prefix_set_index and prefix_get_index). The heap keeps
+     this index up to date, so that an element can be found in O(1);
+     this allows to change its priority or to remove it in O(log n).
+
+   An assert macro must also be defined (e.g. the one in error.h). */
 
 #define INSTANTIATE_HEAP(prefix)                                        \
                                                                         \
 prefix ## _priority_t prefix ## _get_priority(prefix ## _elt_id_t tid); \
 _Bool prefix ## _is_gt_priority(prefix ## _priority_t a, prefix ## _priority_t b); \
+void prefix ## _set_index(prefix ## _elt_id_t tid, unsigned int index); \
+unsigned int prefix ## _get_index(prefix ## _elt_id_t tid);             \
                                                                         \
 struct prefix ## _heap {                                                \
   /* Number of elements currently in the heap. */                       \
   unsigned int size;                                                    \
-  prefix ## _elt_id_t *  array;                                    \
+  /* Maximum number of elements in the heap. */                         \
+  unsigned int capacity;                                                \
+  prefix ## _elt_id_t *  array;                                         \
 };                                                                      \
                                                                         \
+/* The element at position i, and the priority of the top. */           \
+static inline prefix ## _elt_id_t                                       \
+prefix ## _elt_at(struct prefix ## _heap *heap, unsigned int i){        \
+  return heap->array[i];                                                \
+}                                                                       \
+static inline prefix ## _priority_t                                     \
+prefix ## _top_priority(struct prefix ## _heap *heap){                  \
+  return prefix ## _get_priority(heap->array[0]);                       \
+}                                                                       \
                                                                         \
+static inline void                                                      \
+prefix ## _place_elt(struct prefix ## _heap *heap, unsigned int i,      \
+                     prefix ## _elt_id_t elt){                          \
+  heap->array[i] = elt;                                                 \
+  prefix ## _set_index(elt, i);                                         \
+}                                                                       \
                                                                         \
-void prefix ## _insert_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
-  /* Temp */ assert(heap->size < user_tasks_image.nb_tasks);            \
-  unsigned int i = heap->size++;                                        \
+/* Put elt in the hole at position i, moving the hole up as long as     \
+   elt has a higher priority than the parent. */                        \
+static inline void                                                      \
+prefix ## _sift_up(struct prefix ## _heap *heap, unsigned int i,        \
+                   prefix ## _elt_id_t elt){                            \
   prefix ## _priority_t priority = prefix ## _get_priority(elt);        \
-  while(1){                                                             \
-    if(i == 0) break;                 /* root */                        \
+  while(i != 0){                                                        \
     unsigned int parent = (i - 1)/2;                                    \
-    if(prefix ## _is_gt_priority(priority,prefix ## _get_priority(heap->array[parent]))) { \
-      heap->array[i] = heap->array[parent];                             \
-      i = parent;                                                       \
-    }                                                                   \
-    else break;                                                         \
+    if(!prefix ## _is_gt_priority(priority,prefix ## _get_priority(heap->array[parent]))) \
+      break;                                                            \
+    prefix ## _place_elt(heap, i, heap->array[parent]);                 \
+    i = parent;                                                         \
   }                                                                     \
-  heap->array[i] = elt;                                                 \
+  prefix ## _place_elt(heap, i, elt);                                   \
 }                                                                       \
                                                                         \
-prefix ## _elt_id_t prefix ## _remove_elt(struct prefix ## _heap *heap) {\
-  prefix ## _elt_id_t res = heap->array[0];                             \
-    /* Temp */ assert(heap->size <= user_tasks_image.nb_tasks);         \  
-  heap->array[0] = heap->array[--heap->size];                           \
-                                                                        \
-  unsigned int i = 0;                                                   \
-  prefix ## _priority_t i_priority = prefix ## _get_priority(heap->array[i]); \
-                                                                        \
+/* Put elt in the hole at position i, moving the hole down as long as   \
+   a child has a higher priority than elt. */                           \
+static inline void                                                      \
+prefix ## _sift_down(struct prefix ## _heap *heap, unsigned int i,      \
+                     prefix ## _elt_id_t elt){                          \
+  prefix ## _priority_t priority = prefix ## _get_priority(elt);        \
+  unsigned int const size = heap->size;                                 \
   while(1){                                                             \
     unsigned int left = 2 * i + 1;                                      \
     unsigned int right = 2 * i + 2;                                     \
-    /* Temp */ assert(i < user_tasks_image.nb_tasks);                   \  
-    unsigned int largest = i;                                           \
-    prefix ## _priority_t largest_priority = i_priority;                \
-    /* prefix ## _priority_t largest_priority = prefix ## _get_priority(heap->array[i]); */ \
-                                                                        \
-    if(right < heap->size){                                             \
+    if(left >= size) break;                                             \
+    unsigned int child = left;                                          \
+    prefix ## _priority_t child_priority = prefix ## _get_priority(heap->array[left]); \
+    if(right < size){                                                   \
       prefix ## _priority_t right_priority = prefix ## _get_priority(heap->array[right]); \
-      if (prefix ## _is_gt_priority(right_priority,largest_priority)){  \
-        largest = right;                                                \
-        largest_priority = right_priority;                              \
-      }                                                                 \
-      /* As right is higher than left, we can skip the test. */         \
-      goto skip;                                                        \
-    }                                                                   \
-    if(left < heap->size){                                              \
-    skip:;                                                              \
-      prefix ## _priority_t left_priority = prefix ## _get_priority(heap->array[left]); \
-      if (prefix ## _is_gt_priority(left_priority,largest_priority)){   \
-        largest = left;                                                 \
-        largest_priority = left_priority;                               \
+      if(prefix ## _is_gt_priority(right_priority,child_priority)){     \
+        child = right;                                                  \
+        child_priority = right_priority;                                \
       }                                                                 \
     }                                                                   \
+    if(!prefix ## _is_gt_priority(child_priority,priority)) break;      \
+    prefix ## _place_elt(heap, i, heap->array[child]);                  \
+    i = child;                                                          \
+  }                                                                     \
+  prefix ## _place_elt(heap, i, elt);                                   \
+}                                                                       \
+                                                                        \
+/* Put elt at position i, which may break the heap property in        \
+   either direction. */                                                 \
+static inline void                                                      \
+prefix ## _sift(struct prefix ## _heap *heap, unsigned int i,           \
+                prefix ## _elt_id_t elt){                               \
+  if(i != 0                                                             \
+     && prefix ## _is_gt_priority(prefix ## _get_priority(elt),         \
+                                  prefix ## _get_priority(heap->array[(i - 1)/2]))) \
+    prefix ## _sift_up(heap, i, elt);                                   \
+  else prefix ## _sift_down(heap, i, elt);                              \
+}                                                                       \
+                                                                        \
+void prefix ## _insert_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size < heap->capacity);                       \
+  unsigned int i = heap->size++;                                        \
+  prefix ## _sift_up(heap, i, elt);                                     \
+}                                                                       \
                                                                         \
-    if(largest == i) return res;                                        \
-    /* swap i and largest. */                                           \
-    prefix ## _elt_id_t tmp = heap->array[i];                           \
-    heap->array[i] = heap->array[largest];                              \
-    heap->array[largest] = tmp;                                         \
+/* Remove the element with the highest priority. */                     \
+prefix ## _elt_id_t prefix ## _remove_elt(struct prefix ## _heap *heap) {\
+  /* Temp */ assert(heap->size > 0);                                    \
+  prefix ## _elt_id_t res = heap->array[0];                             \
+  prefix ## _elt_id_t last = heap->array[--heap->size];                 \
+  if(heap->size > 0) prefix ## _sift_down(heap, 0, last);               \
+  return res;                                                           \
+}                                                                       \
+                                                                        \
+/* Remove elt, which must be in the heap, wherever it is. */            \
+void prefix ## _remove_handle(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  unsigned int i = prefix ## _get_index(elt);                           \
+  /* Temp */ assert(i < heap->size);                                    \
+  prefix ## _elt_id_t last = heap->array[--heap->size];                 \
+  if(i != heap->size) prefix ## _sift(heap, i, last);                   \
+}                                                                       \
+                                                                        \
+/* To be called when the priority of elt, which is in the heap, has     \
+   changed (increase-key or decrease-key). */                           \
+void prefix ## _update_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  unsigned int i = prefix ## _get_index(elt);                           \
+  /* Temp */ assert(i < heap->size);                                    \
+  prefix ## _sift(heap, i, elt);                                        \
+}                                                                       \
+                                                                        \
+/* Remove the element with the highest priority, and insert elt in      \
+   its place, with a single sift. The heap must not be empty. */        \
+prefix ## _elt_id_t prefix ## _replace_top(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size > 0);                                    \
+  prefix ## _elt_id_t res = heap->array[0];                             \
+  prefix ## _sift_down(heap, 0, elt);                                   \
+  return res;                                                           \
+}                                                                       \
+                                                                        \
+/* Same as insert followed by remove, but with at most one sift: if     \
+   elt has at least the priority of the top, it is returned directly. */ \
+prefix ## _elt_id_t prefix ## _push_pop(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  if(heap->size == 0                                                    \
+     || !prefix ## _is_gt_priority(prefix ## _get_priority(heap->array[0]), \
+                                   prefix ## _get_priority(elt)))       \
+    return elt;                                                         \
+  return prefix ## _replace_top(heap, elt);                             \
+}                                                                       \
+                                                                        \
+/* Batch insertion: append elements with prefix_append_elt, which       \
+   breaks the heap property, then call prefix_restore with the size     \
+   of the heap before the first append. Depending on the number of      \
+   appended elements, this sifts them up one by one, or rebuilds the    \
+   heap in O(n) (bottom-up, Floyd's method). */                         \
+void prefix ## _append_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size < heap->capacity);                       \
+  prefix ## _place_elt(heap, heap->size++, elt);                        \
+}                                                                       \
                                                                         \
-    i = largest;                                                        \
+void prefix ## _heapify(struct prefix ## _heap *heap){                  \
+  if(heap->size < 2) return;                                            \
+  for(unsigned int i = (heap->size - 2)/2 + 1; i-- > 0;)                \
+    prefix ## _sift_down(heap, i, heap->array[i]);                      \
+}                                                                       \
+                                                                        \
+void prefix ## _restore(struct prefix ## _heap *heap, unsigned int from){ \
+  unsigned int const size = heap->size;                                 \
+  unsigned int depth = 0;                                               \
+  for(unsigned int n = size; n > 0; n /= 2) depth++;                    \
+  if((size - from) * depth > size) prefix ## _heapify(heap);            \
+  else for(unsigned int i = from; i < size; i++)                        \
+         prefix ## _sift_up(heap, i, heap->array[i]);                   \
+}                                                                       \
+                                                                        \
+/* Remove all the elements whose priority is not lower than bound,      \
+   calling f on each of them. When there are few, they are removed      \
+   from the top; else they are filtered out in a single pass over the   \
+   array, and the heap is rebuilt in O(n). */                           \
+static inline void                                                      \
+prefix ## _remove_up_to(struct prefix ## _heap *heap, prefix ## _priority_t bound, \
+                        void (*f)(prefix ## _elt_id_t)){                \
+  unsigned int budget = 1;                                              \
+  for(unsigned int n = heap->size; n > 0; n /= 2) budget++;             \
+  while(heap->size > 0 && !prefix ## _is_gt_priority(bound, prefix ## _get_priority(heap->array[0]))){ \
+    if(budget-- == 0){                                                  \
+      unsigned int j = 0;                                               \
+      for(unsigned int i = 0; i < heap->size; i++){                     \
+        if(!prefix ## _is_gt_priority(bound, prefix ## _get_priority(heap->array[i]))) f(heap->array[i]); \
+        else prefix ## _place_elt(heap, j++, heap->array[i]);           \
+      }                                                                 \
+      heap->size = j;                                                   \
+      prefix ## _heapify(heap);                                         \
+      return;                                                           \
+    }                                                                   \
+    f(prefix ## _remove_elt(heap));                                     \
   }                                                                     \
 }
 
+/* A variant of the above, with the same interface, but better cache
+   behaviour:
 
+   - The array contains (priority, element) pairs, so that comparisons
+     do not have to fetch the priority from the element. The priority
+     is read once, when the element is inserted or updated; the
+     element must then not change its priority without calling
+     prefix_update_elt.
 
-#if 0
-/* Unit test and example of instantiation. */
+   - Each node has arity children (e.g. 2, 4 or 8), which makes the
+     heap shallower. The children of node i are at arity * i + 1 ...
+     arity * i + arity. The entries are padded to a power of two, and
+     the arity is a power of two such that arity * sizeof(entry) is at
+     most a cache line; so if the array is allocated with
+     DARY_HEAP_STORAGE or DARY_HEAP_ARRAY_IN, all the children of a
+     node are in the same cache line. With 32-bit pointers, this is an
+     arity of at most 8 with int priorities, and 4 with dates. */
 
-/* An instance of the heap. */
-typedef int test_priority_t;
-typedef int test_elt_id_t;
-static inline test_priority_t test_get_priority(test_elt_id_t tid) {return tid;}
-static inline _Bool test_is_gt_priority(test_priority_t a, test_priority_t b) {
-  return a > b;
-}
-
-INSTANTIATE_HEAP(test)
-
-#include <stdio.h>
-#include <assert.h>
-
-#define NB_ELTS 8
-
-int the_heap_array[NB_ELTS];
-  
-struct test_heap the_heap = {
-    .size = 0,
-    .array = &the_heap_array[0],
-};
+#ifndef DARY_HEAP_CACHE_LINE
+#define DARY_HEAP_CACHE_LINE 64
+#endif
 
-int after_heap;
-struct test_heap *heap = &the_heap;
-  
-void check_is_a_heap(void){
-  for(unsigned int i = 0; i < heap->size; i++){
-    test_priority_t ip = test_get_priority(heap->array[i]);
-    unsigned int left = 2 * i + 1;
-    
-    if(left >= heap->size) break;
-    test_priority_t lp = test_get_priority(heap->array[left]);
-    assert(!test_is_gt_priority(lp,ip));
-    
-    unsigned int right = 2 * i + 2;
-    if(right >= heap->size) break;    
-    test_priority_t rp = test_get_priority(heap->array[right]);
-    assert(!test_is_gt_priority(rp,ip));
-  }
-}
+/* The smallest power of two that holds n bytes (n <= 64). */
+#define DARY_HEAP_POW2(n) ((n) <= 4 ? 4 : (n) <= 8 ? 8 : (n) <= 16 ? 16 : (n) <= 32 ? 32 : 64)
 
-void print_elt_array(void){
-  printf("|");
-  for(unsigned int i = 0; i < heap->size; i++){
-    printf("%d|", heap->array[i]);
-  }
-  printf("\n");
+#define INSTANTIATE_DARY_HEAP(prefix, arity)                            \
+_Static_assert((arity) >= 2, "A heap has at least two children per node"); \
+_Static_assert(((arity) & ((arity) - 1)) == 0, "The arity must be a power of two"); \
+prefix ## _priority_t prefix ## _get_priority(prefix ## _elt_id_t tid); \
+_Bool prefix ## _is_gt_priority(prefix ## _priority_t a, prefix ## _priority_t b); \
+void prefix ## _set_index(prefix ## _elt_id_t tid, unsigned int index); \
+unsigned int prefix ## _get_index(prefix ## _elt_id_t tid);             \
+                                                                        \
+/* The priority is cached next to the element, so that comparisons      \
+   do not need to dereference the element. */                           \
+struct prefix ## _heap_entry {                                          \
+  prefix ## _priority_t priority;                                       \
+  prefix ## _elt_id_t elt;                                              \
+} __attribute__((aligned(DARY_HEAP_POW2(sizeof(prefix ## _priority_t)   \
+                                        + sizeof(prefix ## _elt_id_t))))); \
+_Static_assert((arity) * sizeof(struct prefix ## _heap_entry) <= DARY_HEAP_CACHE_LINE, \
+               "The children of a node must fit in a cache line");      \
+                                                                        \
+struct prefix ## _heap {                                                \
+  /* Number of elements currently in the heap. */                       \
+  unsigned int size;                                                    \
+  /* Maximum number of elements in the heap. */                         \
+  unsigned int capacity;                                                \
+  struct prefix ## _heap_entry *  array;                                \
+};                                                                      \
+                                                                        \
+static inline prefix ## _elt_id_t                                       \
+prefix ## _elt_at(struct prefix ## _heap *heap, unsigned int i){        \
+  return heap->array[i].elt;                                            \
+}                                                                       \
+static inline prefix ## _priority_t                                     \
+prefix ## _top_priority(struct prefix ## _heap *heap){                  \
+  return heap->array[0].priority;                                       \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+prefix ## _place_entry(struct prefix ## _heap *heap, unsigned int i,    \
+                       struct prefix ## _heap_entry entry){             \
+  heap->array[i] = entry;                                               \
+  prefix ## _set_index(entry.elt, i);                                   \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+prefix ## _sift_up(struct prefix ## _heap *heap, unsigned int i,        \
+                   struct prefix ## _heap_entry entry){                 \
+  while(i != 0){                                                        \
+    unsigned int parent = (i - 1)/(arity);                              \
+    if(!prefix ## _is_gt_priority(entry.priority, heap->array[parent].priority)) \
+      break;                                                            \
+    prefix ## _place_entry(heap, i, heap->array[parent]);               \
+    i = parent;                                                         \
+  }                                                                     \
+  prefix ## _place_entry(heap, i, entry);                               \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+prefix ## _sift_down(struct prefix ## _heap *heap, unsigned int i,      \
+                     struct prefix ## _heap_entry entry){               \
+  unsigned int const size = heap->size;                                 \
+  while(1){                                                             \
+    unsigned int first = (arity) * i + 1;                               \
+    if(first >= size) break;                                            \
+    unsigned int last = first + (arity);                                \
+    if(last > size) last = size;                                        \
+    unsigned int child = first;                                         \
+    for(unsigned int c = first + 1; c < last; c++)                      \
+      if(prefix ## _is_gt_priority(heap->array[c].priority,             \
+                                   heap->array[child].priority))        \
+        child = c;                                                      \
+    if(!prefix ## _is_gt_priority(heap->array[child].priority, entry.priority)) \
+      break;                                                            \
+    prefix ## _place_entry(heap, i, heap->array[child]);                \
+    i = child;                                                          \
+  }                                                                     \
+  prefix ## _place_entry(heap, i, entry);                               \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+prefix ## _sift(struct prefix ## _heap *heap, unsigned int i,           \
+                struct prefix ## _heap_entry entry){                    \
+  if(i != 0                                                             \
+     && prefix ## _is_gt_priority(entry.priority,                       \
+                                  heap->array[(i - 1)/(arity)].priority)) \
+    prefix ## _sift_up(heap, i, entry);                                 \
+  else prefix ## _sift_down(heap, i, entry);                            \
+}                                                                       \
+                                                                        \
+static inline struct prefix ## _heap_entry                              \
+prefix ## _make_entry(prefix ## _elt_id_t elt){                         \
+  struct prefix ## _heap_entry entry =                                  \
+    { .priority = prefix ## _get_priority(elt), .elt = elt };           \
+  return entry;                                                         \
+}                                                                       \
+                                                                        \
+void prefix ## _insert_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size < heap->capacity);                       \
+  unsigned int i = heap->size++;                                        \
+  prefix ## _sift_up(heap, i, prefix ## _make_entry(elt));              \
+}                                                                       \
+                                                                        \
+prefix ## _elt_id_t prefix ## _remove_elt(struct prefix ## _heap *heap) { \
+  /* Temp */ assert(heap->size > 0);                                    \
+  prefix ## _elt_id_t res = heap->array[0].elt;                         \
+  struct prefix ## _heap_entry last = heap->array[--heap->size];        \
+  if(heap->size > 0) prefix ## _sift_down(heap, 0, last);               \
+  return res;                                                           \
+}                                                                       \
+                                                                        \
+void prefix ## _remove_handle(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  unsigned int i = prefix ## _get_index(elt);                           \
+  /* Temp */ assert(i < heap->size);                                    \
+  struct prefix ## _heap_entry last = heap->array[--heap->size];        \
+  if(i != heap->size) prefix ## _sift(heap, i, last);                   \
+}                                                                       \
+                                                                        \
+void prefix ## _update_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  unsigned int i = prefix ## _get_index(elt);                           \
+  /* Temp */ assert(i < heap->size);                                    \
+  prefix ## _sift(heap, i, prefix ## _make_entry(elt));                 \
+}                                                                       \
+                                                                        \
+prefix ## _elt_id_t prefix ## _replace_top(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size > 0);                                    \
+  prefix ## _elt_id_t res = heap->array[0].elt;                         \
+  prefix ## _sift_down(heap, 0, prefix ## _make_entry(elt));            \
+  return res;                                                           \
+}                                                                       \
+                                                                        \
+prefix ## _elt_id_t prefix ## _push_pop(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  struct prefix ## _heap_entry entry = prefix ## _make_entry(elt);      \
+  if(heap->size == 0                                                    \
+     || !prefix ## _is_gt_priority(heap->array[0].priority, entry.priority)) \
+    return elt;                                                         \
+  prefix ## _elt_id_t res = heap->array[0].elt;                         \
+  prefix ## _sift_down(heap, 0, entry);                                 \
+  return res;                                                           \
+}                                                                       \
+                                                                        \
+/* Batch insertion: append elements with prefix_append_elt, which       \
+   breaks the heap property, then call prefix_restore with the size     \
+   of the heap before the first append. Depending on the number of      \
+   appended elements, this sifts them up one by one, or rebuilds the    \
+   heap in O(n) (bottom-up, Floyd's method). */                         \
+void prefix ## _append_elt(struct prefix ## _heap *heap, prefix ## _elt_id_t elt){ \
+  /* Temp */ assert(heap->size < heap->capacity);                       \
+  prefix ## _place_entry(heap, heap->size++, prefix ## _make_entry(elt)); \
+}                                                                       \
+                                                                        \
+void prefix ## _heapify(struct prefix ## _heap *heap){                  \
+  if(heap->size < 2) return;                                            \
+  for(unsigned int i = (heap->size - 2)/(arity) + 1; i-- > 0;)          \
+    prefix ## _sift_down(heap, i, heap->array[i]);                      \
+}                                                                       \
+                                                                        \
+void prefix ## _restore(struct prefix ## _heap *heap, unsigned int from){ \
+  unsigned int const size = heap->size;                                 \
+  unsigned int depth = 0;                                               \
+  for(unsigned int n = size; n > 0; n /= (arity)) depth++;              \
+  if((size - from) * depth > size) prefix ## _heapify(heap);            \
+  else for(unsigned int i = from; i < size; i++)                        \
+         prefix ## _sift_up(heap, i, heap->array[i]);                   \
+}                                                                       \
+                                                                        \
+/* Remove all the elements whose priority is not lower than bound,      \
+   calling f on each of them. When there are few, they are removed      \
+   from the top; else they are filtered out in a single pass over the   \
+   array, and the heap is rebuilt in O(n). */                           \
+static inline void                                                      \
+prefix ## _remove_up_to(struct prefix ## _heap *heap, prefix ## _priority_t bound, \
+                        void (*f)(prefix ## _elt_id_t)){                \
+  unsigned int budget = 1;                                              \
+  for(unsigned int n = heap->size; n > 0; n /= (arity)) budget++;       \
+  while(heap->size > 0 && !prefix ## _is_gt_priority(bound, heap->array[0].priority)){ \
+    if(budget-- == 0){                                                  \
+      unsigned int j = 0;                                               \
+      for(unsigned int i = 0; i < heap->size; i++){                     \
+        if(!prefix ## _is_gt_priority(bound, heap->array[i].priority)) f(heap->array[i].elt); \
+        else prefix ## _place_entry(heap, j++, heap->array[i]);         \
+      }                                                                 \
+      heap->size = j;                                                   \
+      prefix ## _heapify(heap);                                         \
+      return;                                                           \
+    }                                                                   \
+    f(prefix ## _remove_elt(heap));                                     \
+  }                                                                     \
 }
 
-#include <limits.h>
-#include <assert.h>
-
-int main(void){
-  print_elt_array();  
-  test_insert_elt(heap,88);
-  print_elt_array();
-  check_is_a_heap();
-  test_insert_elt(heap,66);
-  print_elt_array();
-  check_is_a_heap();
-  test_insert_elt(heap,44);
-  print_elt_array();
-  check_is_a_heap();  
-  test_insert_elt(heap,77);
-  print_elt_array();
-  check_is_a_heap();  
-  test_insert_elt(heap,11);
-  print_elt_array();
-  check_is_a_heap();  
-  test_insert_elt(heap,55);
-  print_elt_array();
-  check_is_a_heap();
-  test_insert_elt(heap,22);
-  print_elt_array();
-  check_is_a_heap();
-  test_insert_elt(heap,33);
-  print_elt_array();
-  check_is_a_heap();
-
-  int last = INT_MAX;
-  for(int i = 0; i < NB_ELTS; i++){
-    int new = test_remove_elt(heap);
-    printf("%d\n", new);
-    print_elt_array();
-    check_is_a_heap();
-    assert(new <= last);
-    last = new;
-  }
+/* Declare the storage for a d-ary heap of n elements, and get the
+   array to put in the heap. The array is shifted so that element 1
+   (the first child of the root) begins on a cache line. */
+#define DARY_HEAP_STORAGE(prefix, name, n)                              \
+  struct prefix ## _heap_entry name[(n) + DARY_HEAP_CACHE_LINE/sizeof(struct prefix ## _heap_entry)] \
+  __attribute__((aligned(DARY_HEAP_CACHE_LINE)))
+#define DARY_HEAP_ARRAY(name) \
+  (&(name)[DARY_HEAP_CACHE_LINE/sizeof((name)[0]) - 1])
 
-  return 0;
-}
-
-#endif
+/* The same, in untyped storage aligned on a cache line. A heap of n
+   elements uses DARY_HEAP_SLICE_SIZE(prefix, n) bytes of it, which
+   is a multiple of the cache line. */
+#define DARY_HEAP_ARRAY_IN(prefix, storage)                             \
+  ((struct prefix ## _heap_entry *) (storage)                           \
+   + DARY_HEAP_CACHE_LINE/sizeof(struct prefix ## _heap_entry) - 1)
+#define DARY_HEAP_SLICE_SIZE(prefix, n)                                 \
+  (DARY_HEAP_CACHE_LINE                                                 \
+   + ((n) * sizeof(struct prefix ## _heap_entry) + DARY_HEAP_CACHE_LINE - 1) \
+   / DARY_HEAP_CACHE_LINE * DARY_HEAP_CACHE_LINE)
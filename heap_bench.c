@@ -0,0 +1,235 @@
+/* Host-side test and benchmark of the heap variants of heap.c.
+
+   Build and run with "make bench". Each variant is first checked
+   (heap property and index of the elements), then timed on:
+   - insert: insertion of size elements in an empty heap;
+   - remove: removal of all the elements of a heap of this size;
+   - mixed: removal of the top followed by insertion of the same
+     element with a later date, in a heap of this size (like periodic
+     tasks going through the waiting heap).
+
+   The batch operations (prefix_append_elt, prefix_restore and
+   prefix_remove_up_to) are also tested.
+
+   The elements mimic struct context: each is on its own cache line,
+   and they are accessed in a random order. The priorities are dates
+   (64 bit, earlier is higher), as in the waiting and EDF heaps; the
+   d-ary entries are then 16 bytes, so that 4 children fill a cache
+   line and 8 would not fit (see INSTANTIATE_DARY_HEAP). The 8-ary
+   heap thus has 32-bit entries, like the FP ready heap on the
+   target: the priority is the high half of the date, and the element
+   its index in contexts. The result guides the choice of HEAP_ARITY
+   in config.h. */
+
+#define _POSIX_C_SOURCE 199309L
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "heap.c"
+
+#define MAX_ELTS 4096
+/* Number of heap operations per measurement, to get stable timings. */
+#define OPS_PER_MEASURE (1 << 20)
+
+struct bench_ctx {
+  uint64_t date;
+  unsigned int index;
+} __attribute__((aligned(64)));
+
+static struct bench_ctx contexts[MAX_ELTS];
+static struct bench_ctx *elts[MAX_ELTS];
+
+#define BENCH_ELT_FUNCTIONS(prefix)                                     \
+  typedef uint64_t prefix ## _priority_t;                               \
+  typedef struct bench_ctx * prefix ## _elt_id_t;                       \
+  static inline prefix ## _priority_t                                   \
+  prefix ## _get_priority(prefix ## _elt_id_t elt) { return elt->date; } \
+  static inline _Bool                                                   \
+  prefix ## _is_gt_priority(prefix ## _priority_t a, prefix ## _priority_t b) { \
+    return a < b;                                                       \
+  }                                                                     \
+  static inline void                                                    \
+  prefix ## _set_index(prefix ## _elt_id_t elt, unsigned int index) {   \
+    elt->index = index;                                                 \
+  }                                                                     \
+  static inline unsigned int                                            \
+  prefix ## _get_index(prefix ## _elt_id_t elt) { return elt->index; }
+
+/* The same, with 32-bit priorities and elements. */
+#define BENCH_ELT32_FUNCTIONS(prefix)                                   \
+  typedef uint32_t prefix ## _priority_t;                               \
+  typedef uint32_t prefix ## _elt_id_t;                                 \
+  static inline prefix ## _priority_t                                   \
+  prefix ## _get_priority(prefix ## _elt_id_t elt) {                    \
+    return contexts[elt].date >> 16;                                    \
+  }                                                                     \
+  static inline _Bool                                                   \
+  prefix ## _is_gt_priority(prefix ## _priority_t a, prefix ## _priority_t b) { \
+    return a < b;                                                       \
+  }                                                                     \
+  static inline void                                                    \
+  prefix ## _set_index(prefix ## _elt_id_t elt, unsigned int index) {   \
+    contexts[elt].index = index;                                        \
+  }                                                                     \
+  static inline unsigned int                                            \
+  prefix ## _get_index(prefix ## _elt_id_t elt) { return contexts[elt].index; }
+
+BENCH_ELT_FUNCTIONS(binary)
+INSTANTIATE_HEAP(binary)
+static struct bench_ctx *binary_array[MAX_ELTS];
+
+BENCH_ELT_FUNCTIONS(dary2)
+INSTANTIATE_DARY_HEAP(dary2, 2)
+static DARY_HEAP_STORAGE(dary2, dary2_storage, MAX_ELTS);
+
+BENCH_ELT_FUNCTIONS(dary4)
+INSTANTIATE_DARY_HEAP(dary4, 4)
+static DARY_HEAP_STORAGE(dary4, dary4_storage, MAX_ELTS);
+
+BENCH_ELT32_FUNCTIONS(dary8)
+INSTANTIATE_DARY_HEAP(dary8, 8)
+static DARY_HEAP_STORAGE(dary8, dary8_storage, MAX_ELTS);
+
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t random_date(void){
+  return ((uint64_t) rand() << 16) ^ rand();
+}
+
+static void reset_elts(unsigned int size){
+  for(unsigned int i = 0; i < size; i++){
+    elts[i]->date = random_date();
+  }
+}
+
+/* For the callback of remove_up_to: the latest removed priority. */
+static uint64_t removed_max;
+
+/* Check the heap property and the indexes; get_elt(i) and
+   get_prio(i) return the element and priority at position i. */
+#define CHECK_HEAP(prefix, heap, arity, get_elt, get_prio)              \
+  for(unsigned int i = 0; i < (heap)->size; i++){                       \
+    assert(prefix ## _get_index(get_elt(i)) == i);                      \
+    assert(get_prio(i) == prefix ## _get_priority(get_elt(i)));         \
+    if(i > 0) assert(!prefix ## _is_gt_priority(get_prio(i), get_prio((i - 1)/(arity)))); \
+  }
+
+/* Test, then benchmark a heap variant for all the sizes; id(ctx)
+   and ctx(id) convert between the contexts and the elements. */
+#define BENCH_VARIANT(prefix, name, arity, array_init, get_elt, get_prio, id, ctx) \
+static void prefix ## _removed(prefix ## _elt_id_t elt){                \
+  if(prefix ## _get_priority(elt) > removed_max)                        \
+    removed_max = prefix ## _get_priority(elt);                         \
+}                                                                       \
+static void bench_ ## prefix(void){                                     \
+  struct prefix ## _heap heap = { .size = 0, .capacity = MAX_ELTS, .array = array_init }; \
+  struct prefix ## _heap *h = &heap;                                    \
+  (void) h;                                                             \
+                                                                        \
+  /* Test: random operations, checking the heap at each step. */        \
+  reset_elts(MAX_ELTS);                                                 \
+  for(unsigned int i = 0; i < 256; i++) prefix ## _insert_elt(&heap, id(elts[i])); \
+  for(unsigned int step = 0; step < 20000; step++){                     \
+    struct bench_ctx *elt = elts[rand() % 256];                         \
+    unsigned int in = elt->index < heap.size && get_elt(elt->index) == id(elt); \
+    switch(rand() % 4){                                                 \
+    case 0: if(!in) prefix ## _insert_elt(&heap, id(elt)); break;       \
+    case 1: if(in) prefix ## _remove_handle(&heap, id(elt)); break;     \
+    case 2: if(in){ elt->date = random_date(); prefix ## _update_elt(&heap, id(elt)); } break; \
+    case 3:                                                             \
+      if(heap.size > 0){                                                \
+        uint64_t top = get_prio(0);                                     \
+        assert(prefix ## _get_priority(prefix ## _remove_elt(&heap)) == top); \
+      }                                                                 \
+      break;                                                            \
+    }                                                                   \
+    CHECK_HEAP(prefix, h, arity, get_elt, get_prio);                    \
+  }                                                                     \
+  /* Test the batch operations, with few and many elements. */          \
+  for(unsigned int batch = 1; batch <= 1024; batch *= 32){              \
+    unsigned int from = heap.size;                                      \
+    for(unsigned int i = 0; i < batch; i++){                            \
+      struct bench_ctx *elt = elts[256 + (rand() % 2048)];              \
+      if(elt->index < heap.size && get_elt(elt->index) == id(elt)) continue; \
+      prefix ## _append_elt(&heap, id(elt));                            \
+    }                                                                   \
+    prefix ## _restore(&heap, from);                                    \
+    CHECK_HEAP(prefix, h, arity, get_elt, get_prio);                    \
+    uint64_t bound = get_prio(heap.size / 2);                           \
+    removed_max = 0;                                                    \
+    prefix ## _remove_up_to(&heap, bound, prefix ## _removed);          \
+    assert(removed_max <= bound);                                       \
+    CHECK_HEAP(prefix, h, arity, get_elt, get_prio);                    \
+    for(unsigned int i = 0; i < heap.size; i++) assert(get_prio(i) > bound); \
+  }                                                                     \
+                                                                        \
+  for(unsigned int size = 8; size <= MAX_ELTS; size *= 2){              \
+    unsigned int rounds = OPS_PER_MEASURE / size;                       \
+    uint64_t t_insert = 0, t_remove = 0, t_mixed = 0;                   \
+    for(unsigned int r = 0; r < rounds; r++){                           \
+      reset_elts(size);                                                 \
+      heap.size = 0;                                                    \
+      uint64_t t0 = now_ns();                                           \
+      for(unsigned int i = 0; i < size; i++) prefix ## _insert_elt(&heap, id(elts[i])); \
+      uint64_t t1 = now_ns();                                           \
+      for(unsigned int i = 0; i < size; i++) prefix ## _remove_elt(&heap); \
+      uint64_t t2 = now_ns();                                           \
+      t_insert += t1 - t0;                                              \
+      t_remove += t2 - t1;                                              \
+    }                                                                   \
+    reset_elts(size);                                                   \
+    heap.size = 0;                                                      \
+    for(unsigned int i = 0; i < size; i++) prefix ## _insert_elt(&heap, id(elts[i])); \
+    uint64_t t0 = now_ns();                                             \
+    for(unsigned int i = 0; i < OPS_PER_MEASURE / 2; i++){              \
+      struct bench_ctx *elt = ctx(prefix ## _remove_elt(&heap));        \
+      elt->date += 1 + (elt->date & 0xFFFF);                            \
+      prefix ## _insert_elt(&heap, id(elt));                            \
+    }                                                                   \
+    t_mixed = now_ns() - t0;                                            \
+    CHECK_HEAP(prefix, h, arity, get_elt, get_prio);                    \
+    unsigned int ops = rounds * size;                                   \
+    printf("%-8s %6u %9.1f %9.1f %9.1f\n", name, size,                  \
+           (double) t_insert / ops, (double) t_remove / ops,            \
+           (double) t_mixed / OPS_PER_MEASURE);                         \
+  }                                                                     \
+}
+
+#define BINARY_ELT(i) (heap.array[i])
+#define BINARY_PRIO(i) (heap.array[i]->date)
+#define DARY_ELT(i) (heap.array[i].elt)
+#define DARY_PRIO(i) (heap.array[i].priority)
+#define PTR_ID(c) (c)
+#define PTR_CTX(e) (e)
+#define INDEX_ID(c) ((uint32_t) ((c) - contexts))
+#define INDEX_CTX(e) (&contexts[e])
+
+BENCH_VARIANT(binary, "binary", 2, binary_array, BINARY_ELT, BINARY_PRIO, PTR_ID, PTR_CTX)
+BENCH_VARIANT(dary2, "2-ary", 2, DARY_HEAP_ARRAY(dary2_storage), DARY_ELT, DARY_PRIO, PTR_ID, PTR_CTX)
+BENCH_VARIANT(dary4, "4-ary", 4, DARY_HEAP_ARRAY(dary4_storage), DARY_ELT, DARY_PRIO, PTR_ID, PTR_CTX)
+BENCH_VARIANT(dary8, "8-ary", 8, DARY_HEAP_ARRAY(dary8_storage), DARY_ELT, DARY_PRIO, INDEX_ID, INDEX_CTX)
+
+int main(void){
+  /* Scatter the elements, so that successive elements are not on
+     neighbouring cache lines. */
+  for(unsigned int i = 0; i < MAX_ELTS; i++) elts[i] = &contexts[i];
+  for(unsigned int i = MAX_ELTS - 1; i > 0; i--){
+    unsigned int j = rand() % (i + 1);
+    struct bench_ctx *tmp = elts[i]; elts[i] = elts[j]; elts[j] = tmp;
+  }
+
+  printf("%-8s %6s %9s %9s %9s  (ns/op)\n", "variant", "size", "insert", "remove", "mixed");
+  bench_binary();
+  bench_dary2();
+  bench_dary4();
+  bench_dary8();
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include "terminal.h"
 #include "user_tasks.h"
 #include "per_cpu.h"
+#include "error.h"
 
 /* Conversion from hw_context to context works because of this. */
 _Static_assert(__builtin_offsetof(struct context,hw_context) == 0,
@@ -49,9 +50,64 @@ syscall_putchar(struct context *ctx, int arg1) {
   hw_context_switch(&ctx->hw_context);
 }
 
+#ifdef BASIC_TASKS
+/* The job of a basic task has returned: the next job will start
+   afresh from the entry point, one period later. The task index is
+   passed to the job in eax. */
+void __attribute__((regparm(3),noreturn,used))
+syscall_job_end(struct context *ctx){
+  unsigned int const i = context_index(ctx);
+  struct task_description const *task = &user_tasks_image.tasks[i];
+  hw_context_job_init(&ctx->hw_context, task->start_pc, i);
+  ctx->sched_context.wakeup_date += task->period;
+#if defined(EDF_SCHEDULING) || defined (DEADLINE_MONITORING)
+  ctx->sched_context.deadline = ctx->sched_context.wakeup_date + task->relative_deadline;
+#endif
+  sched_set_waiting(ctx);
+  struct context *new_ctx  = sched_choose_next();
+  hw_context_switch(&new_ctx->hw_context);
+}
+#endif
+
+#ifdef MUTEXES
+/* The mutex is contended; see mutex.c. */
+void __attribute__((regparm(3),noreturn,used))
+syscall_mutex_lock(struct context *ctx, unsigned int m){
+  hw_context_switch(&sched_mutex_lock(ctx, m)->hw_context);
+}
+
+void __attribute__((regparm(3),noreturn,used))
+syscall_mutex_unlock(struct context *ctx, unsigned int m){
+  hw_context_switch(&sched_mutex_unlock(ctx, m)->hw_context);
+}
+#endif
+
+#ifdef USER_INTERRUPTS
+void __attribute__((regparm(3),noreturn,used))
+syscall_wait_irq(struct context *ctx){
+  hw_context_switch(&sched_wait_irq(ctx)->hw_context);
+}
+
+void __attribute__((noreturn))
+high_level_irq_handler(struct hw_context *cur_hw_ctx, unsigned int irq){
+  struct context *cur_ctx = (struct context *) cur_hw_ctx;
+  hw_context_switch(&sched_irq(cur_ctx, irq)->hw_context);
+}
+#endif
+
 void * const syscall_array[SYSCALL_NUMBER] __attribute__((used)) = {
   [SYSCALL_YIELD] = syscall_yield,
   [SYSCALL_PUTCHAR] = syscall_putchar,
+#ifdef BASIC_TASKS
+  [SYSCALL_JOB_END] = syscall_job_end,
+#endif
+#ifdef MUTEXES
+  [SYSCALL_MUTEX_LOCK] = syscall_mutex_lock,
+  [SYSCALL_MUTEX_UNLOCK] = syscall_mutex_unlock,
+#endif
+#ifdef USER_INTERRUPTS
+  [SYSCALL_WAIT_IRQ] = syscall_wait_irq,
+#endif
 };
 
 void __attribute__((noreturn,used))
@@ -80,12 +136,32 @@ void context_init(struct context * const ctx, int idx,
 
 void __attribute__((noreturn))
 high_level_init(void){
-  unsigned int const nb_tasks = user_tasks_image.nb_tasks;
+  unsigned int const nb_tasks = NB_USER_TASKS;
   
   for(unsigned int i = 0; i < nb_tasks; i++){
     struct task_description const *task = &user_tasks_image.tasks[i];
-    context_init(task->context, i, task->start_pc,
+    struct context *ctx = task_context(i);
+    context_init(ctx, i, task->start_pc,
                  (uint32_t) task->task_begin, (uint32_t) task->task_end);
+    /* Each task gets its index in eax. */
+    hw_context_job_init(&ctx->hw_context, task->start_pc, i);
+#ifdef USER_IO_PORTS
+    hw_context_io_init(&ctx->hw_context, task->io_ports, task->nb_io_ports);
+#endif
+#ifdef BASIC_TASKS
+    /* Tasks sharing an image share its stack: they must not preempt
+       each other. */
+    for(unsigned int j = 0; j < i; j++){
+      struct task_description const *other = &user_tasks_image.tasks[j];
+      if(other->task_begin == task->task_begin
+         && (task_priority(j) != task_priority(i)
+#ifdef TIME_PARTITIONING
+             || other->partition != task->partition
+#endif
+             ))
+        fatal("Tasks %d and %d share a stack but not a preemption level\n", j, i);
+    }
+#endif
   }
 
   for(int i =0; i < NUM_CPUS; i++ ){
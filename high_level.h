@@ -26,9 +26,72 @@ void high_level_init(void);
 void
 high_level_timer_interrupt_handler(struct hw_context *cur_hw_ctx, date_t curtime);
 
+#ifdef USER_INTERRUPTS
+/* IRQ irq, bound to a task, was raised; it is masked and acknowledged. */
+void __attribute__((noreturn))
+high_level_irq_handler(struct hw_context *cur_hw_ctx, unsigned int irq);
+#endif
+
+/* The kernel reads the system description through user_tasks_image.
+   In the specialized build, SYSTEM_DESC_CONSTANTS names the header
+   generated along with the description (see system_desc_gen), and the
+   number of tasks, their contexts and priorities, and the number of
+   tasks of each partition (see partition_nb_tasks) become
+   compile-time constants. */
+#ifdef SYSTEM_DESC_CONSTANTS
+#include SYSTEM_DESC_CONSTANTS
+extern struct context system_contexts[SYSTEM_NB_TASKS];
+#define NB_USER_TASKS SYSTEM_NB_TASKS
+#define task_context(i) (&system_contexts[i])
+#define context_index(ctx) ((unsigned int) ((ctx) - system_contexts))
+#ifdef FP_SCHEDULING
+static const unsigned int system_task_priorities[SYSTEM_NB_TASKS] = SYSTEM_TASK_PRIORITIES;
+#define task_priority(i) (system_task_priorities[i])
+#endif
+#else
+#define NB_USER_TASKS (user_tasks_image.nb_tasks)
+#define task_context(i) (user_tasks_image.tasks[i].context)
+/* The contexts of the tasks must be contiguous, in the order of the
+   tasks, in a single array (as system_contexts in
+   HIGH_LEVEL_SYSTEM_DESC). */
+#define context_index(ctx) ((unsigned int) ((ctx) - user_tasks_image.tasks[0].context))
+#define task_priority(i) (user_tasks_image.tasks[i].priority)
+#endif
+
 /**************** For system description ****************/
 
+#ifdef HEAP_ARITY
+/* With HEAP_ARITY, the heaps keep their entries (a priority and a
+   context, at most HEAP_ENTRY_MAX bytes) in storage aligned on cache
+   lines; each heap wastes at most two lines for the alignment (see
+   DARY_HEAP_SLICE_SIZE in heap.c). The ready heaps are one per
+   partition. */
+#define HEAP_ENTRY_MAX 16
+#define HEAP_STORAGE(name, NB_TASKS, NB_HEAPS)                          \
+  char name[(NB_TASKS) * HEAP_ENTRY_MAX + 2 * (NB_HEAPS) * DARY_HEAP_CACHE_LINE] \
+  __attribute__((aligned(DARY_HEAP_CACHE_LINE)))
+#define HIGH_LEVEL_HEAP_DESC(NB_TASKS)                          \
+  HEAP_STORAGE(ready_heap_storage, NB_TASKS, MAX_PARTITIONS);   \
+  HEAP_STORAGE(waiting_heap_storage, NB_TASKS, 1);
+#else
+#define HIGH_LEVEL_HEAP_DESC(NB_TASKS)
+#endif
+
+#ifdef DEADLINE_MONITORING
+#ifdef HEAP_ARITY
+#define HIGH_LEVEL_DEADLINE_DESC(NB_TASKS)              \
+  HEAP_STORAGE(deadline_heap_storage, NB_TASKS, 1);
+#else
+#define HIGH_LEVEL_DEADLINE_DESC(NB_TASKS)              \
+  struct context *deadline_heap_array[NB_TASKS];
+#endif
+#else
+#define HIGH_LEVEL_DEADLINE_DESC(NB_TASKS)
+#endif
+
 #define HIGH_LEVEL_SYSTEM_DESC(NB_TASKS)                \
-  struct context system_contexts[NB_TASKS];
+  struct context system_contexts[NB_TASKS];             \
+  HIGH_LEVEL_HEAP_DESC(NB_TASKS)                        \
+  HIGH_LEVEL_DEADLINE_DESC(NB_TASKS)
 
 #endif /* __HIGH_LEVEL_H__ */
@@ -0,0 +1,150 @@
+/* Timer using the HPET: its main counter is the clock, and its
+   comparator 0, in one-shot mode, raises the interrupts.
+
+   The HPET is found with its ACPI table. It is used in legacy
+   replacement mode, where comparator 0 replaces the PIT on IRQ0; the
+   PIT is left unused. Both the counter and the
+   comparator must be 64 bits wide, so that they never wrap. */
+
+#include "timer.h"
+#include "config.h"
+#include <stdint.h>
+#include "low_level.h"
+#include "high_level.h"
+#include "terminal.h"
+#include "error.h"
+#include "x86/port.h"
+#include "x86/irq.h"
+#include "x86/acpi.h"
+#include "clock_scale.h"
+
+#define _1_NANOSECOND 1ULL
+#define _1_MICROSECOND (1000ULL * _1_NANOSECOND)
+#define _1_MILLISECOND (1000ULL * _1_MICROSECOND)
+#define _1_SECOND (1000ULL * _1_MILLISECOND)
+#define FEMTOSECONDS_PER_NANOSECOND 1000000ULL
+
+/* There is no tick; this is only the granularity of the timing
+   wheel. */
+const duration_t timer_tick = _1_MILLISECOND;
+
+#define HPET_CAPABILITIES 0x00  /* The period, in fs, is in the high half. */
+#define HPET_CONFIG 0x10
+#define HPET_COUNTER 0xF0
+#define HPET_T0_CONFIG 0x100
+#define HPET_T0_COMPARATOR 0x108
+
+#define HPET_CAP_64BIT (1 << 13)
+#define HPET_CONFIG_ENABLE (1 << 0)
+#define HPET_CONFIG_LEGACY_REPLACEMENT (1 << 1)
+#define HPET_TN_INT_ENABLE (1 << 2)
+#define HPET_TN_64BIT_CAP (1 << 5)
+
+/* A comparator is only matched if the counter has not passed it when
+   it is written; this many cycles are left for the write. */
+#define HPET_MIN_DELTA 64
+
+static volatile uint32_t *hpet;
+
+static inline uint32_t hpet_read(unsigned int reg){
+  return hpet[reg / 4];
+}
+
+static inline void hpet_write(unsigned int reg, uint32_t val){
+  hpet[reg / 4] = val;
+}
+
+/* The high half is read again, in case the low one wrapped. */
+static inline uint64_t hpet_counter(void){
+  uint32_t hi, lo;
+  do {
+    hi = hpet_read(HPET_COUNTER + 4);
+    lo = hpet_read(HPET_COUNTER);
+  } while(hi != hpet_read(HPET_COUNTER + 4));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+static inline void hpet_set_comparator(uint64_t val){
+  hpet_write(HPET_T0_COMPARATOR + 4, val >> 32);
+  hpet_write(HPET_T0_COMPARATOR, val);
+}
+
+/* Only comparator 0 is enabled, on IRQ0. */
+void init_pic(void){
+  isa_irq_init(1 << 0);
+}
+
+void init_apic(void){
+}
+
+static struct scale hpet_to_ns;
+static struct scale ns_to_hpet;
+
+static uint64_t next_wake_date = DATE_FAR_AWAY;
+
+date_t timer_current_time(void){
+  return scale(hpet_counter(), hpet_to_ns);
+}
+
+/* Program comparator 0 for next_wake_date. */
+static void timer_arm(void){
+  /* Rounded up, so that the interrupt does not come too early. */
+  uint64_t target = scale(next_wake_date, ns_to_hpet) + 1;
+  hpet_set_comparator(target);
+  /* If the date has passed, the interrupt is raised a bit later. */
+  uint64_t now;
+  while((now = hpet_counter()) + HPET_MIN_DELTA / 2 >= target){
+    target = now + HPET_MIN_DELTA;
+    hpet_set_comparator(target);
+  }
+}
+
+void timer_wake_at(date_t next_wakeup){
+  if(next_wakeup == next_wake_date) return;
+  next_wake_date = next_wakeup;
+  if(next_wakeup == DATE_FAR_AWAY) hpet_set_comparator(~0ULL);
+  else timer_arm();
+}
+
+void timer_dont_wake(void){
+  timer_wake_at(DATE_FAR_AWAY);
+}
+
+void timer_init(void){
+  struct acpi_header const *table = acpi_find_table("HPET");
+  if(table == NULL) fatal("No HPET\n");
+  /* The address is in the Generic Address Structure after the block
+     id. */
+  hpet = (volatile uint32_t *) *(uint32_t const *) ((char const *) (table + 1) + 8);
+
+  if(!(hpet_read(HPET_CAPABILITIES) & HPET_CAP_64BIT)
+     || !(hpet_read(HPET_T0_CONFIG) & HPET_TN_64BIT_CAP))
+    fatal("The HPET is not 64 bits wide\n");
+  uint32_t const period_fs = hpet_read(HPET_CAPABILITIES + 4);
+  terminal_print("HPET at %d kHz\n",
+                 (uint32_t) (_1_SECOND * FEMTOSECONDS_PER_NANOSECOND / period_fs / 1000));
+  hpet_to_ns = scale_init(period_fs, FEMTOSECONDS_PER_NANOSECOND);
+  ns_to_hpet = scale_init(FEMTOSECONDS_PER_NANOSECOND, period_fs);
+
+  /* Restart the counter from 0, with comparator 0 one-shot. */
+  hpet_write(HPET_CONFIG, 0);
+  hpet_write(HPET_COUNTER, 0);
+  hpet_write(HPET_COUNTER + 4, 0);
+  hpet_write(HPET_T0_CONFIG, HPET_TN_INT_ENABLE);
+  hpet_set_comparator(~0ULL);
+  hpet_write(HPET_CONFIG, HPET_CONFIG_ENABLE | HPET_CONFIG_LEGACY_REPLACEMENT);
+}
+
+void __attribute__((regparm(3),noreturn,used))
+timer_interrupt_handler(struct hw_context *cur_hw_ctx){
+  /* Acknowledge interrupt. */
+  isa_irq_eoi(0);
+  date_t const cur = timer_current_time();
+  if(cur >= next_wake_date){
+    next_wake_date = DATE_FAR_AWAY;
+    high_level_timer_interrupt_handler(cur_hw_ctx, cur);
+  }
+  /* An early interrupt; else, the high level has armed the timer. */
+  else if(next_wake_date != DATE_FAR_AWAY) timer_arm();
+  hw_context_switch(cur_hw_ctx);
+}
@@ -8,6 +8,8 @@
 #include "high_level.h"
 #include "config.h"
 #include "error.h"
+#include "x86/irq.h"
+#include "x86/cpu.h"
 
 /* As Qemu can dump the state before each basic block, the following
    fake jump is useful to debug assembly code.  */
@@ -119,7 +121,14 @@ struct tss
    uint32_t unused_gs;         
    uint32_t unused_ldt;      
    uint16_t unused_trap;
+#ifdef USER_IO_PORTS
+   uint16_t iomap_base;        // Offset of iomap.
+   /* One bit per port, set to fault; the last byte must be all
+      ones. */
+   uint8_t iomap[65536 / 8 + 1];
+#else
    uint16_t unused_iomap_base;
+#endif
 } __attribute__((packed));
 
 /* TSS for the processors. */
@@ -127,6 +136,31 @@ struct tss
 #define current_cpu() 0
 static struct tss tss_array[NUM_CPUS];
 
+#ifdef USER_IO_PORTS
+/* The ports granted in the bitmap of each processor. */
+static uint16_t const *granted_io_ports[NUM_CPUS];
+static unsigned int nb_granted_io_ports[NUM_CPUS];
+
+static inline void iomap_set(uint8_t *iomap, uint16_t const *ports,
+                             unsigned int nb, _Bool deny){
+  for(unsigned int i = 0; i < nb; i++){
+    if(deny) iomap[ports[i] / 8] |= 1 << (ports[i] % 8);
+    else iomap[ports[i] / 8] &= ~(1 << (ports[i] % 8));
+  }
+}
+
+/* Only the bits of the previous and new lists change. */
+static inline void iomap_switch(struct hw_context const *ctx){
+  unsigned int const cpu = current_cpu();
+  if(ctx->io_ports == granted_io_ports[cpu]) return;
+  uint8_t *const iomap = tss_array[cpu].iomap;
+  iomap_set(iomap, granted_io_ports[cpu], nb_granted_io_ports[cpu], 1);
+  iomap_set(iomap, ctx->io_ports, ctx->nb_io_ports, 0);
+  granted_io_ports[cpu] = ctx->io_ports;
+  nb_granted_io_ports[cpu] = ctx->nb_io_ports;
+}
+#endif
+
 /**************** GDT and segment descriptors. ****************/
 
 /* A note on x86 privilege.
@@ -185,7 +219,15 @@ _Static_assert(_KERNEL_DATA_SEGMENT_INDEX == KERNEL_DATA_SEGMENT_INDEX,
                "because it is used in inline assembly: "
                "set it to KERNEL_DATA_SEGMENT_INDEX");
 
+#if defined(MUTEXES) && defined(USER_INTERRUPTS)
+#define _SYSCALL_NUMBER 5
+#elif defined(MUTEXES)
+#define _SYSCALL_NUMBER 4
+#elif defined(BASIC_TASKS) || defined(USER_INTERRUPTS)
+#define _SYSCALL_NUMBER 3
+#else
 #define _SYSCALL_NUMBER 2
+#endif
 _Static_assert(_SYSCALL_NUMBER == SYSCALL_NUMBER,
                "_SYSCALL_NUMBER must be a separate macro "
                "because it is used in inline assembly: "
@@ -240,6 +282,30 @@ asm_syscall_handler:\n\
 .size asm_syscall_handler, . - asm_syscall_handler\n\
 ");
 
+#ifdef SYSENTER_SYSCALLS
+/* SYSENTER loads the kernel cs and ss, and esp with the end of the
+   frame of the current context, as esp0 in the TSS (see
+   hw_context_switch); interrupts are disabled. This builds the frame
+   that int would have pushed, and continues as asm_syscall_handler;
+   cs and ss still hold the selectors of the task. The task saves its
+   flags itself (see SYSENTER_INSTRUCTION). */
+extern void asm_sysenter_handler(void);
+
+/* Without SYSENTER, the MSRs do not exist; the tasks use int 0x27. */
+static int sysenter_present;
+asm("\
+.global asm_sysenter_handler\n\t\
+.type asm_sysenter_handler, @function\n\
+asm_sysenter_handler:\n\
+        mov %eax, -20(%esp)     /* eip */\n\
+        movl $0x202, -12(%esp)  /* flags, with interrupts enabled */\n\
+        mov %ebp, -8(%esp)      /* esp */\n\
+        sub $20, %esp\n\
+        jmp asm_syscall_handler\n\
+.size asm_sysenter_handler, . - asm_sysenter_handler\n\
+");
+#endif
+
 /* MAYBE: share the code. */
 extern void asm_timer_interrupt_handler(void);
 asm("\
@@ -315,9 +381,112 @@ unimplemented_interrupt_handler2:               \n\
 
 
 
+/* The local APIC and IOAPIC registers, if used (see x86/apic.h and
+   x86/ioapic.h). */
+volatile uint32_t *lapic;
+volatile uint32_t *ioapic;
+struct ioapic_isa_route ioapic_isa_routes[16];
+
 void init_pic(void);
 void init_apic(void);
 
+#ifdef USER_INTERRUPTS
+/* One entry per ISA IRQ; they pass the IRQ to irq_interrupt_handler.
+   IRQ0 is the timer. */
+extern void (* const asm_irq_handlers[16])(void);
+asm("\
+.irp irq,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n\
+asm_irq_handler_\\irq:\n\
+	pusha\n\
+	cld\n\
+        movw $(" XSTRING(_KERNEL_DATA_SEGMENT_INDEX) " << 3), %ax \n\
+        movw %ax, %ds\n\
+        mov %esp, %eax\n\
+	mov $(kernel_stack +" XSTRING(KERNEL_STACK_SIZE) "), %esp\n\
+        mov $\\irq, %edx\n\
+        /* Note: must use the regparm3 calling ABI. */\n\
+	call irq_interrupt_handler\n\
+        jmp error_infinite_loop\n\
+.endr\n\
+.pushsection .rodata\n\
+.global asm_irq_handlers\n\
+asm_irq_handlers:\n\
+        .long 0\n\
+.irp irq,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n\
+        .long asm_irq_handler_\\irq\n\
+.endr\n\
+.popsection\n\
+");
+
+/* The line stays masked until its task waits for it again. */
+void __attribute__((regparm(3),noreturn,used))
+irq_interrupt_handler(struct hw_context *cur_hw_ctx, unsigned int irq){
+  isa_irq_set_masked(irq, 1);
+  isa_irq_eoi(irq);
+  high_level_irq_handler(cur_hw_ctx, irq);
+}
+
+void hw_irq_enable(unsigned int irq){
+  isa_irq_set_masked(irq, 0);
+}
+#endif
+
+#ifdef FPU_CONTEXT
+/* The context whose registers are in the FPU of each processor, or
+   NULL. */
+static struct hw_context *fpu_owner[NUM_CPUS];
+
+/* Only the owner can use the FPU without a fault. */
+static inline void fpu_switch(struct hw_context const *ctx){
+  if(ctx == fpu_owner[current_cpu()]) clts();
+  else write_cr0(read_cr0() | CR0_TS);
+}
+
+extern void asm_fpu_interrupt_handler(void);
+asm("\
+.global asm_fpu_interrupt_handler\n\t\
+.type asm_fpu_interrupt_handler, @function\n\
+asm_fpu_interrupt_handler:\n\
+	pusha\n\
+	cld\n\
+        movw $(" XSTRING(_KERNEL_DATA_SEGMENT_INDEX) " << 3), %ax \n \
+        movw %ax, %ds\n\
+        mov %esp, %eax\n\
+	mov $(kernel_stack +" XSTRING(KERNEL_STACK_SIZE) "), %esp\n\
+        /* Note: must use the regparm3 calling ABI. */\n\
+	call fpu_interrupt_handler\n\
+        jmp error_infinite_loop\n\
+.size asm_fpu_interrupt_handler, . - asm_fpu_interrupt_handler\n\
+");
+
+/* #NM: the task uses the FPU, and it does not own it. The faulting
+   instruction is restarted. */
+void __attribute__((regparm(3),noreturn,used))
+fpu_interrupt_handler(struct hw_context *cur_hw_ctx){
+  struct hw_context *const owner = fpu_owner[current_cpu()];
+  clts();
+  if(owner != NULL) fxsave(owner->fpu_state);
+  fxrstor(cur_hw_ctx->fpu_state);
+  fpu_owner[current_cpu()] = cur_hw_ctx;
+  hw_context_switch(cur_hw_ctx);
+}
+
+/* The FPU is initially disabled. */
+static void fpu_init(void){
+  if(!(cpuid(1).edx & CPUID_1_EDX_FXSR)) fatal("No fxsave\n");
+  write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+  write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_TS);
+}
+#endif
+
+#ifdef TIMER_FAST_PATH
+/* The timer backend filters the ticks first (see pit_timer.c). */
+extern void asm_timer_fast_path(void);
+#define TIMER_INTERRUPT_ENTRY asm_timer_fast_path
+#else
+#define TIMER_INTERRUPT_ENTRY asm_timer_interrupt_handler
+#endif
+
 void init_interrupts(void){
   init_pic();
   init_apic();
@@ -327,13 +496,20 @@ void init_interrupts(void){
                                               gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
                                               0, S32BIT);
   }
+#ifdef FPU_CONTEXT
+  fpu_init();
+  idt[DEVICE_NOT_AVAILABLE_INTERRUPT_NUMBER] =
+    create_interrupt_gate_descriptor((uintptr_t) &asm_fpu_interrupt_handler,
+                                     gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
+                                     0, S32BIT);
+#endif
   idt[SOFTWARE_INTERRUPT_NUMBER] =
     create_interrupt_gate_descriptor((uintptr_t) &asm_syscall_handler,
                                      gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
                                      3, S32BIT);
   
   idt[TIMER_INTERRUPT_NUMBER] =
-    create_interrupt_gate_descriptor((uintptr_t) &asm_timer_interrupt_handler,
+    create_interrupt_gate_descriptor((uintptr_t) &TIMER_INTERRUPT_ENTRY,
                                      gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
                                      0, S32BIT);
 
@@ -341,6 +517,24 @@ void init_interrupts(void){
     create_interrupt_gate_descriptor((uintptr_t) &unimplemented_interrupt_handler,
                                      gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
                                      0, S32BIT);
+
+  idt[APIC_SPURIOUS_INTERRUPT_NUMBER] =
+    create_interrupt_gate_descriptor((uintptr_t) &ignore_interrupt_handler,
+                                     gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
+                                     0, S32BIT);
+
+#ifdef USER_INTERRUPTS
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    unsigned int const irq = user_tasks_image.tasks[i].irq;
+    if(irq == 0) continue;
+    if(irq == 2 || irq >= 16) fatal("Task %d is bound to the invalid IRQ %d\n", i, irq);
+    idt[TIMER_INTERRUPT_NUMBER + irq] =
+      create_interrupt_gate_descriptor((uintptr_t) asm_irq_handlers[irq],
+                                       gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX),
+                                       0, S32BIT);
+    isa_irq_route(irq);
+  }
+#endif
   
   struct idt_register {
     uint16_t limit; /* Maximum offset to access an entry in the GDT. */
@@ -381,13 +575,21 @@ idle(struct hw_context* ctx){
   asm volatile
     ("mov %0,%%esp" : : "r"((uint32_t) ctx + sizeof(struct pusha) + sizeof(struct intra_privilege_interrupt_frame)) : "memory");
   asm("sti");
-  asm("hlt");
-  asm("jmp error_infinite_loop");
+  /* An interrupt that does not switch context (see TIMER_FAST_PATH)
+     returns here. */
+  asm("1: hlt\n\
+       jmp 1b");
   __builtin_unreachable ();
 }
 
 #include "per_cpu.h"
 
+/* The context last loaded on each processor: its TSS esp0, I/O
+   bitmap and user segment descriptors are still in place, which is
+   the common case of a task resumed after a syscall or an
+   interrupt. The idle context never replaces it. */
+static struct hw_context *loaded_hw_context[NUM_CPUS];
+
 void __attribute__((noreturn))
 hw_context_switch(struct hw_context* ctx){
   /* terminal_print("Switching to %x\n", ctx); */
@@ -395,23 +597,38 @@ hw_context_switch(struct hw_context* ctx){
   /* terminal_print("Code segment is %llx\n", ctx->code_segment);   */
   /* terminal_print("Data segment is %llx\n", ctx->data_segment); */
   
-  /* We will save the context in the context structure. */
-  tss_array[current_cpu()].esp0 = (uint32_t) ctx + sizeof(struct pusha) + sizeof(struct inter_privilege_interrupt_frame);
-
-#ifndef ROUND_ROBIN_SCHEDULING
+  /* The idle task runs in the kernel, and needs none of this. */
   if(ctx == &user_tasks_image.idle_ctx_array[current_cpu()].hw_context){ idle(ctx); }
+
+  if(ctx != loaded_hw_context[current_cpu()]){
+    loaded_hw_context[current_cpu()] = ctx;
+
+    /* We will save the context in the context structure. */
+    tss_array[current_cpu()].esp0 = (uint32_t) ctx + sizeof(struct pusha) + sizeof(struct inter_privilege_interrupt_frame);
+#ifdef SYSENTER_SYSCALLS
+    if(sysenter_present)
+      wrmsr(MSR_IA32_SYSENTER_ESP, tss_array[current_cpu()].esp0);
+#endif
+
+#ifdef USER_IO_PORTS
+    iomap_switch(ctx);
+#endif
+#ifdef FPU_CONTEXT
+    fpu_switch(ctx);
 #endif
 
 #ifdef FIXED_SIZE_GDT
-  system_gdt.user_code_descriptor = ctx->code_segment;
-  system_gdt.user_data_descriptor = ctx->data_segment;
+    system_gdt.user_code_descriptor = ctx->code_segment;
+    system_gdt.user_data_descriptor = ctx->data_segment;
 #elif defined(DYNAMIC_DESCRIPTORS)
-  system_gdt.user_code_descriptor =
-    create_code_descriptor(ctx->start_address, ctx->memsize,3,0,1,0,1,S32BIT);
-  system_gdt.user_data_descriptor =  
-    create_data_descriptor(ctx->start_address, ctx->memsize,3,0,1,0,1,S32BIT);
+    system_gdt.user_code_descriptor =
+      create_code_descriptor(ctx->start_address, ctx->memsize,3,0,1,0,1,S32BIT);
+    system_gdt.user_data_descriptor =  
+      create_data_descriptor(ctx->start_address, ctx->memsize,3,0,1,0,1,S32BIT);
 #endif  
+  }
   
+  /* The interrupt entries load the kernel ds: always restore it. */
   /* terminal_print("ds reg will be %x\n", ctx->iframe.ss); */
   load_ds_reg(ctx->iframe.ss);
   /* Load the context. */
@@ -495,6 +712,13 @@ void hw_context_init(struct hw_context* ctx, uint32_t pc,
 #endif
   ctx->iframe.ss = (gdt_segment_selector(3, DATA_INDEX));
 
+#ifdef FPU_CONTEXT
+  /* The state after fninit, with all the SSE exceptions masked. */
+  for(unsigned int i = 0; i < sizeof(ctx->fpu_state); i++) ctx->fpu_state[i] = 0;
+  *(uint16_t *) &ctx->fpu_state[0] = 0x037F;    /* FCW */
+  *(uint32_t *) &ctx->fpu_state[24] = 0x1F80;   /* MXCSR */
+#endif
+
   /* terminal_print("Init ctx is %x; ", ctx); */
 
 #if defined(FIXED_SIZE_GDT)  /* || defined(DYNAMIC_DESCRIPTORS) */
@@ -517,6 +741,19 @@ void hw_context_init(struct hw_context* ctx, uint32_t pc,
 
 }
 
+void hw_context_job_init(struct hw_context* ctx, uint32_t pc, uint32_t arg){
+  ctx->iframe.eip = pc;
+  ctx->regs.eax = arg;
+  ctx->iframe.flags = (1 << 1) | (1 << 9);
+}
+
+#ifdef USER_IO_PORTS
+void hw_context_io_init(struct hw_context* ctx, uint16_t const *ports, unsigned int nb){
+  ctx->io_ports = ports;
+  ctx->nb_io_ports = nb;
+}
+#endif
+
 struct module_information {
   char *mod_start;
   char *mod_end;
@@ -579,9 +816,24 @@ low_level_init(uint32_t magic_value, struct multiboot_information *mbi)
       gdt->tss_descriptor[i] =
         create_tss_descriptor((uint32_t) &tss_array[i], sizeof(tss_array[i]), 3,0,0);
       tss_array[i].ss0 = gdt_segment_selector(0,KERNEL_DATA_SEGMENT_INDEX);
+#ifdef USER_IO_PORTS
+      /* No port is granted. */
+      tss_array[i].iomap_base = offsetof(struct tss, iomap);
+      for(unsigned int j = 0; j < sizeof(tss_array[i].iomap); j++)
+        tss_array[i].iomap[j] = 0xFF;
+#endif
     }
+#ifdef MUTEXES
+    if(user_tasks_image.nb_mutexes == 0)
+      fatal("MUTEXES needs at least one mutex in the system description\n");
+    /* Byte-granular, so that the tasks see only the mutexes. */
+    gdt->shared_data_descriptor =
+      create_data_descriptor((uint32_t) user_tasks_image.mutexes,
+                             user_tasks_image.nb_mutexes * sizeof(mutex_t) - 1,
+                             3,0,1,0,0,S32BIT);
+#endif
 
-    lgdt((segment_descriptor_t *) gdt,sizeof(struct system_gdt) + user_tasks_image.nb_tasks * sizeof(struct user_task_descriptors));
+    lgdt((segment_descriptor_t *) gdt,sizeof(struct system_gdt) + NB_USER_TASKS * sizeof(struct user_task_descriptors));
     /* terminal_writestring("After lgdt\n"); */
 
     load_code_segment(gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX));
@@ -591,6 +843,22 @@ low_level_init(uint32_t magic_value, struct multiboot_information *mbi)
     /* terminal_writestring("after load data segments\n"); */
     
     load_tr(gdt_segment_selector(0,TSS_SEGMENTS_FIRST_INDEX));
+
+#ifdef SYSENTER_SYSCALLS
+    _Static_assert(KERNEL_DATA_SEGMENT_INDEX == KERNEL_CODE_SEGMENT_INDEX + 1,
+                   "SYSENTER takes the kernel ss after the kernel cs");
+    sysenter_present = sysenter_supported();
+    if(sysenter_present){
+      wrmsr(MSR_IA32_SYSENTER_CS, gdt_segment_selector(0,KERNEL_CODE_SEGMENT_INDEX));
+      wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t) &asm_sysenter_handler);
+    }
+#endif
+
+#ifdef MUTEXES
+    /* The kernel does not use gs, and the tasks keep it on iret, as
+       its privilege is 3. */
+    load_gs(gdt_segment_selector(3,SHARED_DATA_SEGMENT_INDEX));
+#endif
   }
 
   /* Set-up the idt. */
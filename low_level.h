@@ -62,6 +62,16 @@ struct hw_context {
   segment_descriptor_t code_segment;
   segment_descriptor_t data_segment;
 #endif  
+#ifdef USER_IO_PORTS
+  /* The I/O ports granted to the task. */
+  uint16_t const *io_ports;
+  unsigned int nb_io_ports;
+#endif
+#ifdef FPU_CONTEXT
+  /* The x87 and SSE registers, as saved by fxsave; valid unless the
+     task owns the FPU. */
+  uint8_t fpu_state[512] __attribute__((aligned(16)));
+#endif
 } __attribute__((packed,aligned(4)));
 
 
@@ -72,16 +82,36 @@ hw_context_init(struct hw_context* ctx, uint32_t pc,
 void
 hw_context_idle_init(struct hw_context* ctx);
 
+/* Restart ctx at pc, with arg in eax; the other registers are not
+   restored. Used to start the tasks, and the jobs of basic tasks. */
+void
+hw_context_job_init(struct hw_context* ctx, uint32_t pc, uint32_t arg);
+
+#ifdef USER_IO_PORTS
+/* Grant the nb ports of the array ports to ctx. */
+void
+hw_context_io_init(struct hw_context* ctx, uint16_t const *ports, unsigned int nb);
+#endif
+
 
 void __attribute__((noreturn))
 hw_context_switch(struct hw_context* ctx);
 
+#ifdef USER_INTERRUPTS
+/* Unmask IRQ irq; it is masked again when it is raised. */
+void
+hw_irq_enable(unsigned int irq);
+#endif
+
 
+#define DEVICE_NOT_AVAILABLE_INTERRUPT_NUMBER 0x07
 #define SOFTWARE_INTERRUPT_NUMBER 0x27
 /* We initialize the pic here, so 0x40...47 are for the master PIC,
    and 0x48...4F for the slave PIC. */
 #define TIMER_INTERRUPT_NUMBER 0x40
 #define SPURIOUS_TIMER_INTERRUPT_NUMBER 0x48
+/* The spurious interrupts of the local APIC are ignored. */
+#define APIC_SPURIOUS_INTERRUPT_NUMBER 0xFF
 
 /**************** For use by user tasks. ****************/
 
@@ -94,34 +124,75 @@ hw_context_switch(struct hw_context* ctx);
 
    First argument (syscall number) is ebx, second is edx, third is ecx, fourth is esi, fifth is edi, sixth is ebp. */
 
+#ifdef SYSENTER_SYSCALLS
+#include "x86/cpu.h"
+
+/* CPUID is not privileged: the kernel and the tasks test the same
+   way. The first Pentium Pro reports SEP without SYSENTER. */
+static inline int
+sysenter_supported(void){
+  uint32_t eax = cpuid(1).eax;
+  uint32_t family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+  if(family == 6 && model < 3 && stepping < 3) return 0;
+  return (cpuid(1).edx & CPUID_1_EDX_SEP) != 0;
+}
+
+/* Tested once per task, as CPUID is slow; -1 until then. */
+static inline int
+sysenter_available(void){
+  static int available = -1;
+  if(available < 0) available = sysenter_supported();
+  return available;
+}
+
+/* SYSENTER saves nothing: the task passes its return address in eax
+   and its stack pointer in ebp (see asm_sysenter_handler). The
+   kernel returns with iret, restoring ebp to the stack pointer, and
+   eax to the return address. The flags are saved on the stack, as the
+   kernel returns with interrupts enabled and the others clear. */
+#define SYSENTER_INSTRUCTION                    \
+  "push %%ebp\n\t"                              \
+  "pushf\n\t"                                   \
+  "call 1f\n"                                   \
+  "1:\tpop %%eax\n\t"                           \
+  "add $(2f - 1b), %%eax\n\t"                   \
+  "mov %%esp, %%ebp\n\t"                        \
+  "sysenter\n"                                  \
+  "2:\tpopf\n\t"                                \
+  "pop %%ebp"
+/* Without SYSENTER, the task falls back to int 0x27. */
+#define SYSCALL(...) do {                                               \
+    if(sysenter_available())                                            \
+      asm volatile (SYSENTER_INSTRUCTION : : __VA_ARGS__ : "eax");      \
+    else                                                                \
+      asm volatile ("int %0" : : __VA_ARGS__);                          \
+  } while(0)
+#else
+#define SYSCALL(...) asm volatile ("int %0" : : __VA_ARGS__)
+#endif
+
 static inline void
 syscall1(uint32_t arg){
-  asm volatile ("int %0": :
-                "i"(SOFTWARE_INTERRUPT_NUMBER),
-                "b"(arg)
-                );
+  SYSCALL("i"(SOFTWARE_INTERRUPT_NUMBER),
+          "b"(arg));
 }
 
 static inline void
 syscall2(uint32_t arg1, uint32_t arg2){
-  asm volatile ("int %0": :
-                "i"(SOFTWARE_INTERRUPT_NUMBER),
-                "b"(arg1),
-                "d"(arg2)
-                );
+  SYSCALL("i"(SOFTWARE_INTERRUPT_NUMBER),
+          "b"(arg1),
+          "d"(arg2));
 }
 
 
 static inline void
 syscall5(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t arg5){
-  asm volatile ("int %0": :
-                "i"(SOFTWARE_INTERRUPT_NUMBER),
-                "b"(arg1),
-                "d"(arg2),
-                "c"(arg3),
-                "S"(arg4),
-                "D"(arg5)                
-                );
+  SYSCALL("i"(SOFTWARE_INTERRUPT_NUMBER),
+          "b"(arg1),
+          "d"(arg2),
+          "c"(arg3),
+          "S"(arg4),
+          "D"(arg5));
 }
 
 
@@ -143,6 +214,9 @@ struct system_gdt {
   segment_descriptor_t user_code_descriptor;
   segment_descriptor_t user_data_descriptor;
 #endif  
+#ifdef MUTEXES
+  segment_descriptor_t shared_data_descriptor; /* The mutexes. */
+#endif
   segment_descriptor_t tss_descriptor[NUM_CPUS];
 #if !(defined(FIXED_SIZE_GDT) || defined(DYNAMIC_DESCRIPTORS))
   struct user_task_descriptors user_task_descriptors[]; /* One per task */
@@ -161,6 +235,10 @@ struct low_level_description {
   (offsetof(struct system_gdt,kernel_data_descriptor)/sizeof(segment_descriptor_t))
 #define TSS_SEGMENTS_FIRST_INDEX \
   (offsetof(struct system_gdt,tss_descriptor)/sizeof(segment_descriptor_t))
+#ifdef MUTEXES
+#define SHARED_DATA_SEGMENT_INDEX \
+  (offsetof(struct system_gdt,shared_data_descriptor)/sizeof(segment_descriptor_t))
+#endif
 #if defined(FIXED_SIZE_GDT) || defined(DYNAMIC_DESCRIPTORS)
 #define USER_CODE_SEGMENT_INDEX \
   (offsetof(struct system_gdt,user_code_descriptor)/sizeof(segment_descriptor_t))
@@ -0,0 +1,141 @@
+#include <stddef.h>
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* Mutexes with priority inheritance. The fast paths are in user space
+   (mutex_lock and mutex_unlock in user_tasks.h): a task takes a free
+   mutex by writing its index plus one, and releases it by writing 0,
+   with an atomic compare-and-swap. The kernel is only called:
+
+   - by mutex_lock, if the mutex is taken: the caller sets
+     MUTEX_WAITERS, so that the owner calls the kernel to release it,
+     and blocks.
+
+   - by mutex_unlock, if MUTEX_WAITERS is set: the mutex is handed to
+     its highest-priority waiter, which becomes ready.
+
+   The owner of a mutex inherits the priority of the tasks blocked on
+   it, if it is higher; this is transitive if the owner is itself
+   blocked. The waiters are found by scanning the tasks, which is in
+   O(n), but only on contention.
+
+   The mutexes are writable by all the tasks, so the kernel checks the
+   owner they hold, and ignores the calls that do not follow the
+   protocol.
+
+   priority_scheduler.c includes this file. The includer must provide
+   mutex_priority_t and:
+   - mutex_get_priority(ctx): the priority of ctx, with inheritance;
+   - mutex_own_priority(ctx): the priority of ctx, without;
+   - mutex_is_gt_priority(a, b): true if a is higher than b;
+   - mutex_set_priority(ctx, p): change the priority of ctx, which
+     may be running, ready, waiting or blocked;
+   - ready_queue_add(ctx): make ctx ready. */
+
+#ifdef MUTEXES
+
+#define NO_MUTEX (~0U)
+
+static inline volatile mutex_t *mutex_word(unsigned int m){
+  return &user_tasks_image.mutexes[m];
+}
+
+/* The owner of a mutex of value v, or NULL if it is free or invalid. */
+static inline struct context *mutex_owner(mutex_t v){
+  unsigned int const i = (v & ~MUTEX_WAITERS) - 1;
+  if(i >= NB_USER_TASKS) return NULL;
+  return task_context(i);
+}
+
+/* The highest-priority task blocked on m, or NULL; *others tells if
+   there are other ones. */
+static struct context *mutex_top_waiter(unsigned int m, _Bool *others){
+  struct context *top = NULL;
+  unsigned int count = 0;
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    struct context *ctx = task_context(i);
+    if(ctx->sched_context.blocked_on != m) continue;
+    count++;
+    if(top == NULL
+       || mutex_is_gt_priority(mutex_get_priority(ctx), mutex_get_priority(top)))
+      top = ctx;
+  }
+  *others = count > 1;
+  return top;
+}
+
+/* Recompute the priority of ctx from the tasks blocked on the mutexes
+   it holds, and propagate the change if ctx is itself blocked. The
+   chain is shorter than the number of tasks, unless they are
+   deadlocked. */
+static void mutex_update_priority(struct context *ctx){
+  for(unsigned int n = 0; ctx != NULL && n < NB_USER_TASKS; n++){
+    mutex_priority_t p = mutex_own_priority(ctx);
+    for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+      struct context *w = task_context(i);
+      unsigned int const m = w->sched_context.blocked_on;
+      if(m != NO_MUTEX && mutex_owner(*mutex_word(m)) == ctx
+         && mutex_is_gt_priority(mutex_get_priority(w), p))
+        p = mutex_get_priority(w);
+    }
+    if(p == mutex_get_priority(ctx)) return;
+    mutex_set_priority(ctx, p);
+    unsigned int const m = ctx->sched_context.blocked_on;
+    if(m == NO_MUTEX) return;
+    ctx = mutex_owner(*mutex_word(m));
+  }
+}
+
+struct context *sched_mutex_lock(struct context *ctx, unsigned int m){
+  if(m >= user_tasks_image.nb_mutexes) return ctx;
+  volatile mutex_t *word = mutex_word(m);
+  mutex_t const v = *word;
+  struct context *owner = mutex_owner(v);
+  if(owner == ctx) return ctx;
+  if(owner == NULL){
+    /* Released in the meantime. */
+    _Bool others;
+    *word = (context_index(ctx) + 1)
+      | (mutex_top_waiter(m, &others) != NULL ? MUTEX_WAITERS : 0);
+    return ctx;
+  }
+  *word = v | MUTEX_WAITERS;
+  ctx->sched_context.blocked_on = m;
+  mutex_update_priority(owner);
+  return sched_choose_next();
+}
+
+struct context *sched_mutex_unlock(struct context *ctx, unsigned int m){
+  if(m >= user_tasks_image.nb_mutexes) return ctx;
+  volatile mutex_t *word = mutex_word(m);
+  if(mutex_owner(*word) != ctx) return ctx;
+  _Bool others;
+  struct context *next = mutex_top_waiter(m, &others);
+  if(next == NULL) *word = 0;
+  else {
+    *word = (context_index(next) + 1) | (others ? MUTEX_WAITERS : 0);
+    next->sched_context.blocked_on = NO_MUTEX;
+    /* next inherits from the remaining waiters. */
+    mutex_update_priority(next);
+    ready_queue_add(next);
+  }
+  mutex_update_priority(ctx);
+  return sched_maybe_preempt(ctx);
+}
+
+static inline void mutex_init(void){
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    struct context *ctx = task_context(i);
+    ctx->sched_context.blocked_on = NO_MUTEX;
+#ifdef EDF_SCHEDULING
+    ctx->sched_context.inherited_deadline = DATE_FAR_AWAY;
+#endif
+  }
+}
+
+#else
+
+static inline void mutex_init(void){}
+
+#endif /* MUTEXES */
@@ -0,0 +1,136 @@
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* Time partitioning, as in ARINC 653: the tasks are grouped in
+   partitions, and time is divided in a major frame that repeats
+   forever. The major frame contains fixed windows, each reserved to
+   one partition; only the tasks of that partition can execute in the
+   window, and the idle context runs between windows. Inside a window,
+   the tasks of the partition are scheduled by the usual scheduler,
+   using one ready queue per partition.
+
+   The schedulers include this file; the switch between windows is
+   driven from the timer path (sched_wake_tasks). Without
+   TIME_PARTITIONING, there is a single partition which is always
+   active, and these functions are folded away by the compiler. */
+
+/* Returned by partition_active when no partition is. */
+#define NO_PARTITION 0xFFFFFFFFU
+
+#ifdef TIME_PARTITIONING
+
+static struct {
+  /* The current window, or the next one if between windows. */
+  unsigned int window;
+  _Bool in_window;
+  date_t frame_start;
+  /* Date of the next window start or end. */
+  date_t next_switch;
+} partition_state;
+
+static inline unsigned int partition_of(struct context const *ctx){
+  return ctx->sched_context.partition;
+}
+
+static inline unsigned int partition_active(void){
+  if(!partition_state.in_window) return NO_PARTITION;
+  return user_tasks_image.windows[partition_state.window].partition;
+}
+
+/* The date at which the timer should wake, given that the scheduler
+   wants to wake at next. */
+static inline date_t partition_next_event(date_t next){
+  if(partition_state.next_switch < next) return partition_state.next_switch;
+  return next;
+}
+
+/* Follow the window table up to curtime. Returns true if the active
+   partition has changed. */
+static inline _Bool partition_update(date_t curtime){
+  unsigned int const before = partition_active();
+  struct partition_window const *windows = user_tasks_image.windows;
+  while(curtime >= partition_state.next_switch){
+    unsigned int w = partition_state.window;
+    if(partition_state.in_window){
+      partition_state.in_window = 0;
+      if(++w == user_tasks_image.nb_windows){
+        w = 0;
+        partition_state.frame_start += user_tasks_image.major_frame;
+      }
+      partition_state.window = w;
+      partition_state.next_switch = partition_state.frame_start + windows[w].offset;
+    }
+    else {
+      partition_state.in_window = 1;
+      partition_state.next_switch =
+        partition_state.frame_start + windows[w].offset + windows[w].duration;
+    }
+  }
+  return partition_active() != before;
+}
+
+#ifdef SYSTEM_DESC_CONSTANTS
+_Static_assert(SYSTEM_NB_PARTITIONS <= MAX_PARTITIONS, "Too many partitions");
+static const unsigned int system_partition_nb_tasks[SYSTEM_NB_PARTITIONS] =
+  SYSTEM_PARTITION_NB_TASKS;
+/* The number of tasks of partition p, which bounds its ready queue. */
+static inline unsigned int partition_nb_tasks(unsigned int p){
+  return p < SYSTEM_NB_PARTITIONS ? system_partition_nb_tasks[p] : 0;
+}
+#else
+static inline unsigned int partition_nb_tasks(unsigned int p){
+  unsigned int n = 0;
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++)
+    if(user_tasks_image.tasks[i].partition == p) n++;
+  return n;
+}
+#endif
+
+static inline void partition_init(void){
+  unsigned int const nb_windows = user_tasks_image.nb_windows;
+  struct partition_window const *windows = user_tasks_image.windows;
+
+  if(user_tasks_image.nb_partitions > MAX_PARTITIONS)
+    fatal("Too many partitions: %d\n", user_tasks_image.nb_partitions);
+  if(nb_windows == 0) fatal("The major frame has no window\n");
+
+  /* Windows must be sorted, disjoint, and inside the major frame. */
+  duration_t end = 0;
+  for(unsigned int i = 0; i < nb_windows; i++){
+    if(windows[i].offset < end || windows[i].duration == 0
+       || windows[i].partition >= user_tasks_image.nb_partitions)
+      fatal("Invalid partition window %d\n", i);
+    end = windows[i].offset + windows[i].duration;
+  }
+  if(end > user_tasks_image.major_frame) fatal("Windows exceed the major frame\n");
+
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    struct task_description const *task = &user_tasks_image.tasks[i];
+    if(task->partition >= user_tasks_image.nb_partitions)
+      fatal("Task %d is in an invalid partition\n", i);
+    task->context->sched_context.partition = task->partition;
+  }
+
+  partition_state.window = 0;
+  partition_state.in_window = 0;
+  partition_state.frame_start = timer_current_time();
+  partition_state.next_switch = partition_state.frame_start + windows[0].offset;
+  partition_update(partition_state.frame_start);
+}
+
+#else
+
+static inline unsigned int partition_of(struct context const *ctx){
+  (void) ctx;
+  return 0;
+}
+static inline unsigned int partition_active(void){ return 0; }
+static inline unsigned int partition_nb_tasks(unsigned int p){
+  return p == 0 ? NB_USER_TASKS : 0;
+}
+static inline date_t partition_next_event(date_t next){ return next; }
+static inline _Bool partition_update(date_t curtime){ (void) curtime; return 0; }
+static inline void partition_init(void){}
+
+#endif /* TIME_PARTITIONING */
@@ -28,60 +28,37 @@ _Static_assert(DIVISOR < MAX_DIVISOR,
                "DIVISOR must fit in a 16bit register");
 
 
+const duration_t timer_tick = ACTUAL_TICK;
+
 #include <stdint.h>
 #include "low_level.h"
 #include "high_level.h"
 #include <stdatomic.h> 
 #include "x86/port.h"
+#include "x86/irq.h"
 
 
 
+/* With IOAPIC_INTERRUPTS, the local APIC is set up by isa_irq_init. */
 void init_apic(void){
-  /* We do not use the APIC for now. But we can use the PIT with the
-     APIC. */
 }
 
-static const uint16_t master_pic_command = 0x20;
-static const uint16_t master_pic_data = 0x21;
-static const uint16_t slave_pic_command = 0xA0;
-static const uint16_t slave_pic_data = 0xA1;
-
-
-/* https://wiki.osdev.org/8259_PIC */
+/* Only the timer IRQ is enabled. The PIC, or the IOAPIC, is set up
+   here. */
 void init_pic(void){
-
-  /* Initialize. Wait for three words on the data port.*/
-  outb(master_pic_command, 0x11);
-  outb(slave_pic_command, 0x11);  
-
-  /* Change the interrupt number from defaults 0x08 and 0x70. */
-  outb(master_pic_data, TIMER_INTERRUPT_NUMBER);
-  outb(slave_pic_data, SPURIOUS_TIMER_INTERRUPT_NUMBER);
-
-  /* Connect master and slave PIC. */
-  outb(master_pic_data, 4);
-  outb(slave_pic_data, 2);
-
-  /* Require explicit end of interrupt. */
-  outb(master_pic_data, 1);
-  outb(slave_pic_data, 1);
-
-  uint8_t activate_none = 0xFF;
-  uint8_t activate_irq0 = 0xFE;
-
-  /* If we want to disable the PIC, we put activate_none here. */
-  outb(master_pic_data, activate_irq0);
-  outb(slave_pic_data, activate_none);  
-
-  
+  isa_irq_init(1 << 0);
 }
 
 static const uint16_t pit_command = 0x43;
 static const uint16_t pit_data = 0x40;
 
+static uint64_t next_wake_date __attribute__((used)) = DATE_FAR_AWAY;
+
+#ifndef TIMER_TICKLESS
+
 #if NUM_CPUS == 1
 /* Time from the boot, in nano-seconds. */
-static /* _Atomic */uint64_t current_time;
+static /* _Atomic */uint64_t current_time __attribute__((used));
 /* No need to read/write time atomically on single core, and if we
    disable interrupts in the kernel.  */
 
@@ -106,44 +83,235 @@ void timer_init(void){
   outb(pit_data, DIVISOR >> 8);
 }
 
+void timer_wake_at(date_t next_wakeup){
+  next_wake_date = next_wakeup;
+}
+
+void timer_dont_wake(void){
+  next_wake_date = DATE_FAR_AWAY;
+}
+
+/* The wakeup date is reached. */
+static inline void timer_expire(void){
+  timer_dont_wake();
+}
+
+/* Temporary: write a & every 10th of second, to show time passing. */
+#define TICKS_PER_MARK 100
+static unsigned int ticks_to_mark __attribute__((used)) = TICKS_PER_MARK;
+
+#ifdef TIMER_FAST_PATH
+#define XSTRING(x) STRING(x)
+#define STRING(x) #x
+#ifdef IOAPIC_INTERRUPTS
+#define FAST_PATH_EOI "\
+        movl %ss:lapic, %eax\n\
+        movl $0, %ss:" XSTRING(LAPIC_EOI) "(%eax)\n"
+#else
+#define FAST_PATH_EOI "\
+        movb $0x20, %al\n\
+        outb %al, $" XSTRING(PIC_MASTER_COMMAND) "\n"
+#endif
+/* Most ticks only advance the time. This is done here, without
+   saving the context nor changing stacks, then the interrupted code
+   resumes. The variables are accessed through ss, which is the kernel
+   data segment in interrupts from both user and kernel mode. The
+   other ticks go on to asm_timer_interrupt_handler, with the time
+   already advanced. ACTUAL_TICK fits in 32 bits. */
+_Static_assert(ACTUAL_TICK < (1ULL << 32), "ACTUAL_TICK must fit in 32 bits");
+asm("\
+.global asm_timer_fast_path\n\
+.type asm_timer_fast_path, @function\n\
+asm_timer_fast_path:\n\
+        push %eax\n\
+        movl %ss:timer_tick, %eax\n\
+        addl %eax, %ss:current_time\n\
+        adcl $0, %ss:current_time+4\n\
+        decl %ss:ticks_to_mark\n\
+        jz 1f\n\
+        /* Slow path if current_time >= next_wake_date. */\n\
+        movl %ss:current_time+4, %eax\n\
+        cmpl %ss:next_wake_date+4, %eax\n\
+        ja 1f\n\
+        jb 2f\n\
+        movl %ss:current_time, %eax\n\
+        cmpl %ss:next_wake_date, %eax\n\
+        jae 1f\n\
+2:\n"
+        FAST_PATH_EOI "\
+        pop %eax\n\
+        iret\n\
+1:      pop %eax\n\
+        jmp asm_timer_interrupt_handler\n\
+.size asm_timer_fast_path, . - asm_timer_fast_path\n\
+");
+#endif
+
+#else
+
+/* Tickless: the PIT is programmed in mode 0 (interrupt on terminal
+   count) for a single shot, which ends at next_wake_date, or is the
+   longest possible if the date is too far. The time is counted in PIT
+   cycles: those before the current shot, plus those elapsed in it,
+   read back from the counter. The cycles between the read-back and
+   the load of a new shot are not seen by the counter; they are
+   measured at boot against channel 2 (see calibrate_reload), and
+   added back on each reprogramming. The shot is only changed when the
+   date does, or when it has ended. */
+
+#define MAX_SHOT MAX_DIVISOR
+
+static uint64_t past_cycles;    /* Before the current shot. */
+static uint32_t shot_cycles;    /* The length of the current shot. */
+static _Bool shot_ended;        /* It must be reloaded. */
+
+/* Cycles lost by each reprogramming, in 1/256 cycle, and the
+   fraction not yet added to past_cycles. */
+static uint32_t reload_lost;
+static uint32_t reload_lost_fraction;
+
+/* Rounded down; exact, without overflowing 64 bits. */
+static inline date_t cycles_to_ns(uint64_t cycles){
+  return (cycles / PIT_HZ) * _1_SECOND + ((cycles % PIT_HZ) * _1_SECOND) / PIT_HZ;
+}
+
+/* Cycles elapsed in the current shot. At the end of the shot, OUT
+   goes high and the counter wraps, but keeps counting down. */
+static uint32_t shot_elapsed(void){
+  /* Read-back the status and count of channel 0. */
+  outb(pit_command, 0xC2);
+  uint8_t const status = inb(pit_data);
+  uint16_t count = inb(pit_data);
+  count |= inb(pit_data) << 8;
+  if(status & 0x40) return 0;   /* The shot is not loaded yet. */
+  if(status & 0x80) return shot_cycles + (uint16_t) -count;
+  return shot_cycles - count;
+}
+
+uint64_t timer_current_time(void){
+  return cycles_to_ns(past_cycles + shot_elapsed());
+}
 
+/* Start a new shot, ending at next_wake_date if possible. cycles
+   were read back just before; the shot starts reload_lost later. */
+static void timer_load(uint64_t cycles){
+  reload_lost_fraction += reload_lost;
+  cycles += reload_lost_fraction >> 8;
+  reload_lost_fraction &= 0xFF;
+  date_t const now = cycles_to_ns(cycles);
+  uint32_t shot = MAX_SHOT;
+  if(next_wake_date <= now) shot = 1;
+  else if(next_wake_date - now < cycles_to_ns(MAX_SHOT)){
+    /* Rounded up, so that the shot does not end too early. */
+    shot = ((next_wake_date - now) * PIT_HZ + _1_SECOND - 1) / _1_SECOND;
+  }
+  past_cycles = cycles;
+  shot_cycles = shot;
+  shot_ended = 0;
+  /* Channel 0, low then high byte, mode 0. */
+  outb(pit_command, 0x30);
+  outb(pit_data, shot & 0xFF);
+  outb(pit_data, shot >> 8);
+}
 
+static inline void timer_program(void){
+  timer_load(past_cycles + shot_elapsed());
+}
 
-static uint64_t next_wake_date = DATE_FAR_AWAY;
+#define PIT_CHANNEL2 0x42
+#define PIT_GATE 0x61           /* Bit 0: gate of channel 2; bit 1: speaker. */
+#define CALIBRATION_RELOADS 256
 
-static int count;
+static uint16_t channel2_count(void){
+  outb(pit_command, 0x80);      /* Latch channel 2. */
+  uint16_t count = inb(PIT_CHANNEL2);
+  count |= inb(PIT_CHANNEL2) << 8;
+  return count;
+}
+
+/* Measure reload_lost: channel 2, with the speaker off, counts the
+   cycles of CALIBRATION_RELOADS reprogrammings, of which channel 0
+   misses some. These are also added to the time. */
+static void calibrate_reload(void){
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+  outb(pit_command, 0xB0);      /* Channel 2, low then high byte, mode 0. */
+  outb(PIT_CHANNEL2, 0xFF);
+  outb(PIT_CHANNEL2, 0xFF);
+  uint64_t const start = past_cycles + shot_elapsed();
+  uint16_t const ref_start = channel2_count();
+  for(unsigned int i = 0; i < CALIBRATION_RELOADS; i++) timer_program();
+  uint16_t const ref_end = channel2_count();
+  uint64_t const seen = past_cycles + shot_elapsed() - start;
+  uint32_t const ref = (uint16_t) (ref_start - ref_end);
+  outb(PIT_GATE, inb(PIT_GATE) & ~0x03);
+  if(ref > seen){
+    reload_lost = ((ref - seen) << 8) / CALIBRATION_RELOADS;
+    past_cycles += ref - seen;
+  }
+}
+
+void timer_init(void){
+  timer_load(0);
+  calibrate_reload();
+}
 
 void timer_wake_at(date_t next_wakeup){
+  if(next_wakeup == next_wake_date && !shot_ended) return;
   next_wake_date = next_wakeup;
+  timer_program();
 }
 
+/* A shot is still needed, to keep the counter from wrapping unseen. */
 void timer_dont_wake(void){
+  timer_wake_at(DATE_FAR_AWAY);
+}
+
+/* The wakeup date is reached. The high level always rearms the timer,
+   which loads a new shot. */
+static inline void timer_expire(void){
   next_wake_date = DATE_FAR_AWAY;
+  shot_ended = 1;
 }
 
+#endif /* TIMER_TICKLESS */
+
 #include "terminal.h"
 
 void __attribute__((regparm(3),noreturn,used))
 timer_interrupt_handler(struct hw_context *cur_hw_ctx){
   /* Acknowledge interrupt. */
-  outb(master_pic_command, 0x20);
+  isa_irq_eoi(0);
 
+#ifndef TIMER_TICKLESS
+#ifndef TIMER_FAST_PATH
   /* This instance is the only one changing the time. So we do not
      need to be atomic. */
   uint64_t cur = *(&current_time);
   cur += ACTUAL_TICK;
   *(&current_time) = cur;
+  ticks_to_mark--;
+#else
+  /* Already advanced by asm_timer_fast_path. */
+  uint64_t const cur = *(&current_time);
+#endif
 
-  /* Temporary: write a & every 10th of second, to show time passing. */
-  if(++count % 100 == 0) {
+  if(ticks_to_mark == 0) {
+    ticks_to_mark = TICKS_PER_MARK;
     terminal_putchar('&');
     /* terminal_print("cur: %llu, next_wake_date: %llu\n",
        (date_t) cur, (date_t) next_wake_date);     */
   }
+#else
+  date_t const cur = timer_current_time();
+  if(cur < next_wake_date){
+    /* The end of a chained shot. */
+    timer_program();
+    hw_context_switch(cur_hw_ctx);
+  }
+#endif
 
-  
   if(cur >= next_wake_date){
-    timer_dont_wake();
+    timer_expire();
     high_level_timer_interrupt_handler(cur_hw_ctx, cur);
   }
   
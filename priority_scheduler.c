@@ -7,29 +7,70 @@
 #include "heap.c"
 
 
-/* Waiting heap: sort the tasks by their next wakeup date. */
-typedef date_t waiting_priority_t;
-typedef struct context * waiting_elt_id_t;
-static waiting_priority_t waiting_get_priority(waiting_elt_id_t ctx){
-  return ctx->sched_context.wakeup_date;
-}
-/* Earlier wake dates have higher priority. */
-static _Bool waiting_is_gt_priority(date_t a, date_t b){
-  return a < b;
-}
-INSTANTIATE_HEAP(waiting);
-static struct waiting_heap waiting_heap;
+#include "waiting_queue.c"
+#include "partition.c"
+#include "cbs.c"
 
-void sched_set_waiting(struct context *ctx){
-  assert(waiting_heap.size <= user_tasks_image.nb_tasks);
-  waiting_insert_elt(&waiting_heap, ctx);
+/* There is one ready queue per partition. The functions taking a
+   context work on the queue of its partition; the others take the
+   partition as argument. */
 
-  /* Set a possible preemption point when we reach the next wakeup. */
-  date_t next_wakeup = waiting_heap.array[0]->sched_context.wakeup_date;
-  timer_wake_at(next_wakeup);
-}
+#ifdef READY_QUEUE_BITMAP
+/* Constant-time ready queue: one FIFO per priority level. */
+#include "bitmap_queue.c"
 
+static struct bitmap_queue ready_queue[MAX_PARTITIONS];
 
+static inline _Bool ready_queue_is_empty(unsigned int p){
+  return bitmap_queue_is_empty(&ready_queue[p]);
+}
+static inline void ready_queue_add(struct context *ctx){
+  bitmap_queue_push_back(&ready_queue[partition_of(ctx)], ctx);
+}
+static inline struct context *ready_queue_take(unsigned int p){
+  return bitmap_queue_pop(&ready_queue[p]);
+}
+/* Return the context to execute instead of ctx; ctx stays at the
+   front of its FIFO if preempted. */
+static inline struct context *ready_queue_preempt(struct context *ctx){
+  struct bitmap_queue *q = &ready_queue[partition_of(ctx)];
+  if(bitmap_queue_is_empty(q)
+     || bitmap_queue_top_priority(q) <= ctx->sched_context.priority)
+    return ctx;
+  struct context *next = bitmap_queue_pop(q);
+  bitmap_queue_push_front(q, ctx);
+  return next;
+}
+/* Put back a context that was running. */
+static inline void ready_queue_requeue(struct context *ctx){
+  bitmap_queue_push_front(&ready_queue[partition_of(ctx)], ctx);
+}
+/* To be called when the priority of ctx has changed. The FIFO is
+   chosen on insertion, so the new priority is used from the next
+   one. */
+static inline void ready_queue_update(struct context *ctx){
+  (void) ctx;
+}
+/* Change the priority of ctx now, moving it to its new FIFO if it is
+   ready. */
+static inline void ready_queue_set_priority(struct context *ctx, unsigned int prio){
+  struct bitmap_queue *q = &ready_queue[partition_of(ctx)];
+  _Bool const ready = bitmap_queue_remove(q, ctx);
+  ctx->sched_context.priority = prio;
+  if(ready) bitmap_queue_push_back(q, ctx);
+}
+/* Tasks woken together are simply appended to their FIFO. */
+static inline void ready_queue_begin_batch(void){}
+static inline void ready_queue_add_batch(struct context *ctx){
+  bitmap_queue_push_back(&ready_queue[partition_of(ctx)], ctx);
+}
+static inline void ready_queue_end_batch(void){}
+static inline void ready_queue_init(void){
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++)
+    bitmap_queue_init(&ready_queue[p]);
+}
+
+#else
 typedef struct context * ready_elt_id_t;
 #ifdef FP_SCHEDULING
 typedef unsigned int ready_priority_t;
@@ -44,23 +85,180 @@ static _Bool ready_is_gt_priority(ready_priority_t a, ready_priority_t b){
 #ifdef EDF_SCHEDULING
 typedef date_t ready_priority_t;
 static ready_priority_t ready_get_priority(ready_elt_id_t ctx){
+#ifdef CBS_RESERVATIONS
+  return ctx->sched_context.cbs_deadline;
+#elif defined(MUTEXES)
+  date_t const inherited = ctx->sched_context.inherited_deadline;
+  if(inherited < ctx->sched_context.deadline) return inherited;
+  return ctx->sched_context.deadline;
+#else
   return ctx->sched_context.deadline;
+#endif
 }
 /* Earlier deadlines have higher priority. */
 static _Bool ready_is_gt_priority(date_t a, date_t b){
   return a < b;
 }
 #endif
+static void ready_set_index(ready_elt_id_t ctx, unsigned int index){
+  ctx->sched_context.heap_index = index;
+}
+static unsigned int ready_get_index(ready_elt_id_t ctx){
+  return ctx->sched_context.heap_index;
+}
+#ifdef HEAP_ARITY
+INSTANTIATE_DARY_HEAP(ready, HEAP_ARITY);
+_Static_assert(sizeof(struct ready_heap_entry) <= HEAP_ENTRY_MAX, "See HEAP_STORAGE");
+/* Defined by HIGH_LEVEL_SYSTEM_DESC. */
+extern char ready_heap_storage[];
+#else
 INSTANTIATE_HEAP(ready);
+#endif
+#include "ready_heaps.c"
 
-static struct ready_heap ready_heap;
+static inline _Bool ready_queue_is_empty(unsigned int p){
+  return ready_heap[p].size == 0;
+}
+static inline void ready_queue_add(struct context *ctx){
+  ready_insert_elt(&ready_heap[partition_of(ctx)], ctx);
+}
+static inline struct context *ready_queue_take(unsigned int p){
+  return ready_remove_elt(&ready_heap[p]);
+}
+/* If the first ready task has a higher priority, it replaces ctx
+   at the top of the heap with a single sift. */
+static inline struct context *ready_queue_preempt(struct context *ctx){
+  return ready_push_pop(&ready_heap[partition_of(ctx)], ctx);
+}
+static inline void ready_queue_requeue(struct context *ctx){
+  ready_queue_add(ctx);
+}
+/* To be called when the priority of ctx has changed. */
+static inline void ready_queue_update(struct context *ctx){
+  struct ready_heap *heap = &ready_heap[partition_of(ctx)];
+  unsigned int const i = ctx->sched_context.heap_index;
+  /* ctx is not in the heap if it is running. */
+  if(i < heap->size && ready_elt_at(heap, i) == ctx) ready_update_elt(heap, ctx);
+}
+#ifdef FP_SCHEDULING
+static inline void ready_queue_set_priority(struct context *ctx, unsigned int prio){
+  ctx->sched_context.priority = prio;
+  ready_queue_update(ctx);
+}
+#endif
+/* Tasks woken together are appended to the heap array, which is then
+   fixed once, possibly by rebuilding it in O(n). */
+static unsigned int ready_batch_start[MAX_PARTITIONS];
+static inline void ready_queue_begin_batch(void){
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++)
+    ready_batch_start[p] = ready_heap[p].size;
+}
+static inline void ready_queue_add_batch(struct context *ctx){
+  ready_append_elt(&ready_heap[partition_of(ctx)], ctx);
+}
+static inline void ready_queue_end_batch(void){
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++)
+    if(ready_heap[p].size != ready_batch_start[p])
+      ready_restore(&ready_heap[p], ready_batch_start[p]);
+}
+static inline void ready_queue_init(void){
+  ready_heaps_init();
+}
+#endif /* READY_QUEUE_BITMAP */
 
-void scheduler_init(void){
-  ready_heap.size = 0;
-  ready_heap.array = user_tasks_image.ready_heap_array;
+#if DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+/* A late task gets the lowest priority until the end of its job. */
+static inline void demote_task(struct context *ctx){
+#ifdef FP_SCHEDULING
+  /* With READY_QUEUE_BITMAP, this also moves a ready ctx to the FIFO
+     of priority 0. */
+  ready_queue_set_priority(ctx, 0);
+#else
+  ctx->sched_context.deadline = DATE_FAR_AWAY;
+  ready_queue_update(ctx);
+#endif
+}
+static inline void restore_task(struct context *ctx){
+#ifdef FP_SCHEDULING
+  unsigned int const i = context_index(ctx);
+  ready_queue_set_priority(ctx, task_priority(i));
+#else
+  /* yield has already set the deadline of the next job. */
+  (void) ctx;
+#endif
+}
+#endif
+#include "deadline_monitor.c"
+
+#ifdef MUTEXES
+/* Priority inheritance; see mutex.c. */
+#ifdef FP_SCHEDULING
+typedef unsigned int mutex_priority_t;
+static inline mutex_priority_t mutex_get_priority(struct context *ctx){
+  return ctx->sched_context.priority;
+}
+static inline mutex_priority_t mutex_own_priority(struct context *ctx){
+  return task_priority(context_index(ctx));
+}
+static inline _Bool mutex_is_gt_priority(mutex_priority_t a, mutex_priority_t b){
+  return a > b;
+}
+static inline void mutex_set_priority(struct context *ctx, mutex_priority_t p){
+  ready_queue_set_priority(ctx, p);
+}
+#else
+/* The inherited deadline is kept apart, as yield changes the own
+   one. */
+typedef date_t mutex_priority_t;
+static inline mutex_priority_t mutex_get_priority(struct context *ctx){
+  return ready_get_priority(ctx);
+}
+static inline mutex_priority_t mutex_own_priority(struct context *ctx){
+  return ctx->sched_context.deadline;
+}
+static inline _Bool mutex_is_gt_priority(mutex_priority_t a, mutex_priority_t b){
+  return a < b;
+}
+static inline void mutex_set_priority(struct context *ctx, mutex_priority_t p){
+  ctx->sched_context.inherited_deadline =
+    p < ctx->sched_context.deadline ? p : DATE_FAR_AWAY;
+  ready_queue_update(ctx);
+}
+#endif
+#endif
+#include "mutex.c"
+#include "sched_timer.c"
+
+/* Set a possible preemption point when we reach the next wakeup,
+   window switch, deadline or end of budget. */
+static inline void arm_timer(void){
+  sched_arm_timer(cbs_next_event(DATE_FAR_AWAY));
+}
+
+/* Called on each context chosen to run. */
+static inline struct context *dispatch(struct context *ctx){
+  /* The timer must also wake when its budget runs out. */
+  if(cbs_dispatch(ctx)) arm_timer();
+  return ctx;
+}
+
+void sched_set_waiting(struct context *ctx){
+  cbs_stop(ctx);
+  deadline_job_end(ctx);
+  waiting_add(ctx);
+  arm_timer();
+}
 
-  waiting_heap.size = 0;
-  waiting_heap.array = user_tasks_image.waiting_heap_array;
+#include "user_irq.c"
+
+void scheduler_init(void){
+  partition_init();
+  deadline_init();
+  cbs_init();
+  mutex_init();
+  user_irq_init();
+  ready_queue_init();
+  waiting_init();
 
 #ifdef FP_SCHEDULING
   /* The idle tasks have a very low priority.  This is probably not
@@ -72,46 +270,55 @@ void scheduler_init(void){
 #endif    
   
   /* Initially, all the tasks are ready. */  
-  unsigned int const nb_tasks = user_tasks_image.nb_tasks;
+  unsigned int const nb_tasks = NB_USER_TASKS;
   for(unsigned int i = 0; i < nb_tasks; i++){
-    struct task_description const *task = &user_tasks_image.tasks[i];    
-    struct context *ctx = task->context;
+    struct context *ctx = task_context(i);
 #ifdef FP_SCHEDULING        
-    ctx->sched_context.priority = task->priority;
+    ctx->sched_context.priority = task_priority(i);
 #endif    
-    ready_insert_elt(&ready_heap, ctx);
+    ready_queue_add(ctx);
   }
 }
 
 
 
+/* A new job of ctx is released. */
+static inline void wake_task(struct context *ctx){
+  deadline_release(ctx);
+  cbs_release(ctx);
+  ready_queue_add_batch(ctx);
+}
+
 /* Wakeup; set some waiting tasks as ready, and maybe preempt
-   others. */
+   others. All the tasks that wake are collected first, and added to
+   the ready queue in a single batch; the caller then does a single
+   preemption check. */
 void sched_wake_tasks(date_t curtime){
-  while(waiting_heap.size > 0
-        && waiting_heap.array[0]->sched_context.wakeup_date <= curtime){
-    struct context *ctx = waiting_remove_elt(&waiting_heap);
-    assert(ready_heap.size <= user_tasks_image.nb_tasks);
-    ready_insert_elt(&ready_heap, ctx);
-  }
+  /* Switch windows first; sched_maybe_preempt will see the change. */
+  partition_update(curtime);
+  deadline_check(curtime);
+  cbs_tick(curtime);
+  ready_queue_begin_batch();
+  waiting_wake(curtime, wake_task);
+  /* The timer is disarmed when it wakes; rearm it. */
+  arm_timer();
+  ready_queue_end_batch();
 }
 
-struct context * sched_maybe_preempt(struct context *ctx){
-  assert(ctx != &user_tasks_image.idle_ctx_array[current_cpu()]);
-  if(ready_heap.size > 0) {
-    ready_priority_t curprio = ready_get_priority(ctx);
-    ready_priority_t firstprio = ready_get_priority(ready_heap.array[0]);    
-    if(ready_is_gt_priority(firstprio, curprio)) {
-      ready_insert_elt(&ready_heap, ctx);
-      return ready_remove_elt(&ready_heap);
-    }
+struct context * sched_choose_next(void){
+  unsigned int const p = partition_active();
+  if(p == NO_PARTITION || ready_queue_is_empty(p)) {
+    return dispatch(&user_tasks_image.idle_ctx_array[current_cpu()]);
   }
-  return ctx;
+  return dispatch(ready_queue_take(p));
 }
 
-struct context * sched_choose_next(void){
-  if(ready_heap.size == 0) {
-    return &user_tasks_image.idle_ctx_array[current_cpu()];
+struct context * sched_maybe_preempt(struct context *ctx){
+  assert(ctx != &user_tasks_image.idle_ctx_array[current_cpu()]);
+  if(partition_of(ctx) != partition_active()){
+    /* The window of the partition of ctx is over. */
+    ready_queue_requeue(ctx);
+    return sched_choose_next();
   }
-  return ready_remove_elt(&ready_heap);
+  return dispatch(ready_queue_preempt(ctx));
 }
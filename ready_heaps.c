@@ -0,0 +1,30 @@
+#include "user_tasks.h"
+#include "high_level.h"
+
+/* One ready heap per partition, for the schedulers that instantiate
+   the ready heap of heap.c. partition.c must be included before.
+   Should be per-cpu. */
+
+static struct ready_heap ready_heap[MAX_PARTITIONS];
+
+/* Each partition gets a slice of the ready heap storage, large enough
+   for all its tasks. */
+static inline void ready_heaps_init(void){
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++){
+    ready_heap[p].size = 0;
+    ready_heap[p].capacity = partition_nb_tasks(p);
+  }
+#ifdef HEAP_ARITY
+  char *storage = ready_heap_storage;
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++){
+    ready_heap[p].array = DARY_HEAP_ARRAY_IN(ready, storage);
+    storage += DARY_HEAP_SLICE_SIZE(ready, ready_heap[p].capacity);
+  }
+#else
+  struct context **array = user_tasks_image.ready_heap_array;
+  for(unsigned int p = 0; p < MAX_PARTITIONS; p++){
+    ready_heap[p].array = array;
+    array += ready_heap[p].capacity;
+  }
+#endif
+}
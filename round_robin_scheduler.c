@@ -1,32 +1,127 @@
+#include <stddef.h>
 #include "scheduler.h"
 #include "user_tasks.h"
 #include "high_level.h"
+#include "per_cpu.h"
+#include "error.h"
 
-/* Execute all the tasks round-robin; do not care about time; none of
-   the tasks ever block. */
-void sched_set_waiting(struct context *ctx){ (void) ctx; }
-void sched_wake_tasks(date_t curtime){ (void) curtime; }
+#include "heap.c"
+#include "waiting_queue.c"
+#include "partition.c"
 
-struct context *sched_maybe_preempt(struct context *ctx){return ctx;}
+/* Time-sharing: the ready tasks are executed round-robin, each for at
+   most RR_QUANTUM before being put at the end of the run list. Tasks
+   leave the run list while they sleep until their wakeup_date; when
+   no task is ready, the idle context runs. */
 
-/* Should be per-cpu. */
-static struct context *current;
+/* The run lists, one per partition: FIFO of the ready contexts,
+   linked through sched_context.next. The current context is not in
+   it. Should be per-cpu. */
+static struct context *run_head[MAX_PARTITIONS];
+static struct context *run_tail[MAX_PARTITIONS];
 
-void scheduler_init(void){
-  unsigned int const nb_tasks = user_tasks_image.nb_tasks;
+/* Date at which the current context must leave the processor, if
+   another is ready. */
+static date_t quantum_end;
 
-  /* Initialize the circular list of contexts. */
-  struct context *prev =  user_tasks_image.tasks[nb_tasks - 1].context;
-  for (unsigned int i = 0; i < nb_tasks; i++)
-    {
-      struct task_description const *task = &user_tasks_image.tasks[i];
-      prev->sched_context.next = task->context;
-      prev = task->context;
-    }
-  current = user_tasks_image.tasks[0].context;
+/* The context returned by the last scheduling decision. */
+static struct context *run_current;
+
+static void run_push(struct context *ctx){
+  unsigned int const p = partition_of(ctx);
+  ctx->sched_context.next = NULL;
+  if(run_head[p] == NULL) run_head[p] = ctx;
+  else run_tail[p]->sched_context.next = ctx;
+  run_tail[p] = ctx;
+}
+
+static struct context *run_pop(unsigned int p){
+  struct context *ctx = run_head[p];
+  run_head[p] = ctx->sched_context.next;
+  return ctx;
+}
+
+/* True if the active partition has a ready task. */
+static _Bool run_ready(void){
+  unsigned int const p = partition_active();
+  return p != NO_PARTITION && run_head[p] != NULL;
+}
+
+#if DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+/* A late task loses the rest of its quantum. */
+static inline void demote_task(struct context *ctx){
+  if(ctx == run_current) quantum_end = 0;
+}
+static inline void restore_task(struct context *ctx){ (void) ctx; }
+#endif
+#include "deadline_monitor.c"
+#include "sched_timer.c"
+
+/* Wake at the next wakeup date, window switch or deadline, or at the
+   end of the quantum if there is someone to preempt to. */
+static void arm_timer(void){
+  sched_arm_timer(run_ready() ? quantum_end : DATE_FAR_AWAY);
+}
+
+/* The timer is armed by sched_choose_next, which is always called
+   next. */
+void sched_set_waiting(struct context *ctx){
+  deadline_job_end(ctx);
+  waiting_add(ctx);
+}
+
+/* A new job of ctx is released. */
+static void wake_task(struct context *ctx){
+  deadline_release(ctx);
+  run_push(ctx);
+}
+
+/* The timer is rearmed by sched_maybe_preempt or sched_choose_next,
+   which are always called next. */
+void sched_wake_tasks(date_t curtime){
+  partition_update(curtime);
+  deadline_check(curtime);
+  waiting_wake(curtime, wake_task);
 }
 
 struct context *sched_choose_next(void){
-  current = current->sched_context.next;
-  return current;
+  quantum_end = timer_current_time() + RR_QUANTUM;
+  struct context *ctx;
+  if(!run_ready()) ctx = &user_tasks_image.idle_ctx_array[current_cpu()];
+  else ctx = run_pop(partition_active());
+  run_current = ctx;
+  arm_timer();
+  return ctx;
+}
+
+struct context *sched_maybe_preempt(struct context *ctx){
+  assert(ctx != &user_tasks_image.idle_ctx_array[current_cpu()]);
+  if(partition_of(ctx) != partition_active()){
+    /* The window of the partition of ctx is over. */
+    run_push(ctx);
+    return sched_choose_next();
+  }
+  date_t const now = timer_current_time();
+  if(run_ready() && now >= quantum_end){
+    run_push(ctx);
+    ctx = run_pop(partition_of(ctx));
+    quantum_end = now + RR_QUANTUM;
+  }
+  run_current = ctx;
+  arm_timer();
+  return ctx;
+}
+
+void scheduler_init(void){
+  unsigned int const nb_tasks = NB_USER_TASKS;
+
+  partition_init();
+  deadline_init();
+  waiting_init();
+
+  /* Initially, all the tasks are ready. */
+  for (unsigned int p = 0; p < MAX_PARTITIONS; p++)
+    run_head[p] = NULL;
+  for (unsigned int i = 0; i < nb_tasks; i++)
+    run_push(task_context(i));
 }
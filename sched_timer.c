@@ -0,0 +1,12 @@
+#include "user_tasks.h"
+#include "high_level.h"
+
+/* Arm the timer for next, the event of the scheduler itself (e.g.
+   the end of a quantum), or earlier for the next wakeup, deadline or
+   window switch. waiting_queue.c, partition.c and deadline_monitor.c
+   must be included before. */
+static inline void sched_arm_timer(date_t next){
+  date_t const wakeup = waiting_next_date();
+  if(wakeup < next) next = wakeup;
+  timer_wake_at(partition_next_event(deadline_next_event(next)));
+}
@@ -22,6 +22,22 @@ struct context *sched_choose_next(void);
 /* Initialize the scheduler. */
 void scheduler_init(void);
 
+#ifdef MUTEXES
+/* The running ctx calls the kernel because mutex m is contended (see
+   mutex.c). Return the context to execute next. */
+struct context *sched_mutex_lock(struct context *ctx, unsigned int m);
+struct context *sched_mutex_unlock(struct context *ctx, unsigned int m);
+#endif
+
+#ifdef USER_INTERRUPTS
+/* The running ctx waits for the next interrupt on its IRQ line (see
+   user_irq.c). Return the context to execute next. */
+struct context *sched_wait_irq(struct context *ctx);
+/* IRQ irq was raised, and masked, while ctx (maybe the idle context)
+   was running. Return the context to execute next. */
+struct context *sched_irq(struct context *ctx, unsigned int irq);
+#endif
+
 
 struct scheduling_context {
   date_t wakeup_date;           /* If active, last time it was awaken. If inactive: next time. */
@@ -31,9 +47,49 @@ struct scheduling_context {
 #ifdef FP_SCHEDULING
   unsigned int priority;
 #endif
-#ifdef ROUND_ROBIN_SCHEDULING
+#ifdef STRIDE_SCHEDULING
+  uint64_t pass;
+  unsigned int stride;
+#endif
+  unsigned int heap_index;      /* Position in the ready or waiting heap, if in one. */
+#ifdef WAITING_TIMING_WHEEL
+  /* Position in the timing wheel, when waiting. */
+  uint64_t wheel_tick;
+  struct context *wheel_next;
+#endif
+#if defined(ROUND_ROBIN_SCHEDULING) || defined(READY_QUEUE_BITMAP)
   struct context *next;
 #endif  
+#ifdef READY_QUEUE_BITMAP
+  struct context *prev;         /* NULL if first in its FIFO, or not queued. */
+#endif
+#ifdef TIME_PARTITIONING
+  unsigned int partition;
+#endif
+#ifdef CBS_RESERVATIONS
+  /* Constant Bandwidth Server; see cbs.c. */
+  duration_t cbs_budget;
+  duration_t cbs_period;
+  duration_t cbs_remaining;
+  date_t cbs_deadline;
+  date_t cbs_start;             /* When the task was last charged. */
+#endif
+#ifdef MUTEXES
+  unsigned int blocked_on;      /* The mutex the task waits for, or NO_MUTEX. */
+#ifdef EDF_SCHEDULING
+  date_t inherited_deadline;    /* DATE_FAR_AWAY if none. */
+#endif
+#endif
+#ifdef DEADLINE_MONITORING
+  /* The current job; see deadline_monitor.c. */
+  date_t job_release;
+  date_t job_deadline;
+  unsigned int monitor_index;   /* Position in the deadline heap. */
+  unsigned int deadline_state;
+  /* Statistics. */
+  unsigned int deadline_misses;
+  duration_t worst_lateness;
+#endif
 };
 
 #endif
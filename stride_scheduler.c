@@ -0,0 +1,172 @@
+#include <stddef.h>
+#include "scheduler.h"
+#include "user_tasks.h"
+#include "high_level.h"
+#include "per_cpu.h"
+#include "error.h"
+
+#include "heap.c"
+#include "waiting_queue.c"
+#include "partition.c"
+
+/* Stride scheduling (proportional share): each task holds tickets,
+   and gets a share of the processor proportional to them. The stride
+   of a task is inversely proportional to its tickets; its pass is
+   advanced by its stride for each quantum it executes (pro rata if it
+   yields before the end). The ready task with the smallest pass runs,
+   for at most STRIDE_QUANTUM if others are ready.
+
+   A task that wakes cannot have a pass smaller than the current one
+   (stride_global_pass), so that sleeping does not accumulate
+   credit. */
+
+/* The stride of a task with one ticket. */
+#define STRIDE_ONE (1U << 20)
+
+typedef struct context * ready_elt_id_t;
+typedef uint64_t ready_priority_t;
+static ready_priority_t ready_get_priority(ready_elt_id_t ctx){
+  return ctx->sched_context.pass;
+}
+/* Smaller passes have higher priority. */
+static _Bool ready_is_gt_priority(ready_priority_t a, ready_priority_t b){
+  return a < b;
+}
+static void ready_set_index(ready_elt_id_t ctx, unsigned int index){
+  ctx->sched_context.heap_index = index;
+}
+static unsigned int ready_get_index(ready_elt_id_t ctx){
+  return ctx->sched_context.heap_index;
+}
+#ifdef HEAP_ARITY
+INSTANTIATE_DARY_HEAP(ready, HEAP_ARITY);
+_Static_assert(sizeof(struct ready_heap_entry) <= HEAP_ENTRY_MAX, "See HEAP_STORAGE");
+/* Defined by HIGH_LEVEL_SYSTEM_DESC. */
+extern char ready_heap_storage[];
+#else
+INSTANTIATE_HEAP(ready);
+#endif
+#include "ready_heaps.c"
+
+/* Pass of the last context chosen to run. */
+static uint64_t stride_global_pass;
+
+/* Date at which the current context started running, and at which it
+   must leave the processor, if another is ready. */
+static date_t quantum_start;
+static date_t quantum_end;
+
+/* The context returned by the last scheduling decision. */
+static struct context *run_current;
+
+/* True if the active partition has a ready task. */
+static _Bool run_ready(void){
+  unsigned int const p = partition_active();
+  return p != NO_PARTITION && ready_heap[p].size != 0;
+}
+
+/* Advance the pass of ctx for its execution since quantum_start. A
+   task alone may run much longer than a quantum, as the timer is not
+   armed for its end: it is charged one quantum at most, so that the
+   product does not overflow. */
+static inline void stride_charge(struct context *ctx, date_t now){
+  uint64_t used = now - quantum_start;
+  if(used > STRIDE_QUANTUM) used = STRIDE_QUANTUM;
+  ctx->sched_context.pass += (ctx->sched_context.stride * used) / STRIDE_QUANTUM;
+}
+
+#if DEADLINE_OVERRUN_POLICY == DEADLINE_OVERRUN_DEMOTE
+/* A late task loses the rest of its quantum. */
+static inline void demote_task(struct context *ctx){
+  if(ctx == run_current) quantum_end = 0;
+}
+static inline void restore_task(struct context *ctx){ (void) ctx; }
+#endif
+#include "deadline_monitor.c"
+#include "sched_timer.c"
+
+/* Wake at the next wakeup date, window switch or deadline, or at the
+   end of the quantum if there is someone to preempt to. */
+static void arm_timer(void){
+  sched_arm_timer(run_ready() ? quantum_end : DATE_FAR_AWAY);
+}
+
+/* Start running ctx. */
+static struct context *dispatch(struct context *ctx, date_t now){
+  if(ctx != &user_tasks_image.idle_ctx_array[current_cpu()])
+    stride_global_pass = ctx->sched_context.pass;
+  quantum_start = now;
+  quantum_end = now + STRIDE_QUANTUM;
+  run_current = ctx;
+  arm_timer();
+  return ctx;
+}
+
+/* The timer is armed by sched_choose_next, which is always called
+   next. */
+void sched_set_waiting(struct context *ctx){
+  stride_charge(ctx, timer_current_time());
+  deadline_job_end(ctx);
+  waiting_add(ctx);
+}
+
+static void wake_task(struct context *ctx){
+  deadline_release(ctx);
+  if(ctx->sched_context.pass < stride_global_pass)
+    ctx->sched_context.pass = stride_global_pass;
+  ready_insert_elt(&ready_heap[partition_of(ctx)], ctx);
+}
+
+/* The timer is rearmed by sched_maybe_preempt or sched_choose_next,
+   which are always called next. */
+void sched_wake_tasks(date_t curtime){
+  partition_update(curtime);
+  deadline_check(curtime);
+  waiting_wake(curtime, wake_task);
+}
+
+struct context *sched_choose_next(void){
+  date_t const now = timer_current_time();
+  if(!run_ready())
+    return dispatch(&user_tasks_image.idle_ctx_array[current_cpu()], now);
+  return dispatch(ready_remove_elt(&ready_heap[partition_active()]), now);
+}
+
+struct context *sched_maybe_preempt(struct context *ctx){
+  assert(ctx != &user_tasks_image.idle_ctx_array[current_cpu()]);
+  date_t const now = timer_current_time();
+  if(partition_of(ctx) != partition_active()){
+    /* The window of the partition of ctx is over. */
+    stride_charge(ctx, now);
+    ready_insert_elt(&ready_heap[partition_of(ctx)], ctx);
+    return sched_choose_next();
+  }
+  if(run_ready() && now >= quantum_end){
+    stride_charge(ctx, now);
+    return dispatch(ready_push_pop(&ready_heap[partition_of(ctx)], ctx), now);
+  }
+  arm_timer();
+  return ctx;
+}
+
+void scheduler_init(void){
+  unsigned int const nb_tasks = NB_USER_TASKS;
+
+  partition_init();
+  deadline_init();
+  waiting_init();
+
+  ready_heaps_init();
+
+  /* Initially, all the tasks are ready. */
+  stride_global_pass = 0;
+  for(unsigned int i = 0; i < nb_tasks; i++){
+    struct task_description const *task = &user_tasks_image.tasks[i];
+    struct context *ctx = task_context(i);
+    if(task->tickets == 0 || task->tickets > STRIDE_ONE)
+      fatal("Task %d has an invalid number of tickets\n", i);
+    ctx->sched_context.stride = STRIDE_ONE / task->tickets;
+    ctx->sched_context.pass = 0;
+    ready_insert_elt(&ready_heap[partition_of(ctx)], ctx);
+  }
+}
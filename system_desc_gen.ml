@@ -1,14 +1,290 @@
 (* let p = Printf.printf;; *)
 let ps = print_string;;
 let pf = Printf.printf;;
-let doit n =
+let ms = 1000 * 1000;;
+let us = 1000;;
+(* Length of each partition window, in nanoseconds. *)
+let window_length = 2 * ms;;
+(* Under MUTEXES, the tasks share this many mutexes. *)
+let nb_mutexes = 4;;
+(* With the periodic tick of the PIT, a job is released on the first
+   tick after its wakeup date, up to a tick late: the analyses take it
+   as a release jitter. As ACTUAL_TICK in pit_timer.c. *)
+let pit_hz = 1193182;;
+let tick_jitter = 1000 * ms * (pit_hz * ms / (1000 * ms)) / pit_hz;;
+
+(* Timing parameters of a task, in nanoseconds. Deadlines are
+   constrained: 0 < wcet <= deadline <= period. They are used by the
+   schedulability analysis, the schedule of CYCLIC_SCHEDULING, the
+   reservations of CBS_RESERVATIONS and the releases of BASIC_TASKS. *)
+type task = {
+  period : int;
+  offset : int;                 (* Release of the first job. *)
+  wcet : int;
+  deadline : int;
+  priority : int option;        (* Deadline-monotonic if None. *)
+};;
+
+(* The default task set: periods of 10, 20 and 40 ms, 1 ms of
+   execution, scaled down (to 1 us at least) so that the utilization
+   of the nb_tasks tasks stays below 0.7. *)
+let default_task nb_tasks i =
+  let period i = 10 * ms * (1 lsl (i mod 3)) in
+  let u = List.fold_left (fun acc j -> acc +. float ms /. float (period j))
+      0. (List.init nb_tasks (fun j -> j)) in
+  let wcet = if u <= 0.7 then ms else max us (int_of_float (0.7 /. u *. float ms) / us * us) in
+  { period = period i; offset = 0; wcet; deadline = period i; priority = None };;
+
+(* Read a task set: one task per line, "period wcet [deadline
+   [priority]]" in microseconds, the deadline being the period by
+   default. Empty lines and lines starting with # are ignored. *)
+let read_tasks file =
+  let ic = open_in file in
+  let tasks = ref [] in
+  (try
+     while true do
+       let line = String.trim (input_line ic) in
+       if line <> "" && line.[0] <> '#' then begin
+         let words = String.split_on_char ' ' (String.map (fun c -> if c = '\t' then ' ' else c) line) in
+         let fields = List.map int_of_string (List.filter (fun w -> w <> "") words) in
+         let task p c d prio = { period = p * us; offset = 0; wcet = c * us; deadline = d * us; priority = prio } in
+         let t = match fields with
+           | [p; c] -> task p c p None
+           | [p; c; d] -> task p c d None
+           | [p; c; d; prio] -> task p c d (Some prio)
+           | _ -> failwith (Printf.sprintf "%s: invalid task \"%s\"" file line) in
+         tasks := t :: !tasks
+       end
+     done
+   with End_of_file -> close_in ic);
+  Array.of_list (List.rev !tasks)
+;;
+
+let check_task i t =
+  if not (0 < t.wcet && t.wcet <= t.deadline && t.deadline <= t.period) then
+    failwith (Printf.sprintf "Task %d: we need 0 < wcet <= deadline <= period" i);
+  match t.priority with
+  | Some p when p <= 0 -> failwith (Printf.sprintf "Task %d: priorities must be positive" i)
+  | _ -> ()
+;;
+
+(* Deadline-monotonic priorities: the shorter the deadline, the higher
+   the priority. Tasks with the same deadline share a level; levels
+   start at 1, as 0 is for the idle contexts and late tasks. Given
+   priorities are kept. *)
+let assign_priorities tasks =
+  let deadlines = Array.to_list (Array.map (fun t -> t.deadline) tasks) in
+  Array.map (fun t -> match t.priority with
+      | Some p -> p
+      | None -> 1 + List.length (List.sort_uniq compare (List.filter (fun d -> d > t.deadline) deadlines)))
+    tasks
+;;
+
+let rec gcd a b = if b = 0 then a else gcd b (a mod b);;
+let lcm a b = a / (gcd a b) * b;;
+
+(**************** Schedulability analysis ****************)
+
+(* Under TIME_PARTITIONING, the tasks of a partition get a window of
+   length window every frame (otherwise, window = frame). In the worst
+   case, they become ready at the end of their window, so the
+   processor time they get in any interval of length t is at least
+   sbf t. *)
+let sbf ~window ~frame t =
+  let k = t / frame and r = t mod frame in
+  k * window + max 0 (r - (frame - window))
+;;
+
+(* The smallest t such that sbf t >= d, for d > 0. *)
+let sbf_inverse ~window ~frame d =
+  let k = (d - 1) / window in
+  k * frame + (frame - window) + (d - k * window)
+;;
+
+(* Response-time analysis for FP_SCHEDULING, with a release jitter
+   J: the worst-case response time of task i among members is J plus
+   the least fixpoint of
+   w = sbf_inverse (C_i + sum over j of ceil((w + J)/T_j) C_j), for
+   the j with a higher or the same priority. None if it exceeds the
+   deadline. *)
+let response_time ~jitter ~window ~frame tasks prios members i =
+  let t = tasks.(i) in
+  let demand r =
+    List.fold_left (fun acc j ->
+        let tj = tasks.(j) in
+        if j <> i && prios.(j) >= prios.(i)
+        then acc + (r + jitter + tj.period - 1) / tj.period * tj.wcet
+        else acc) t.wcet members in
+  let rec fix r =
+    if r + jitter > t.deadline then None
+    else
+      let r' = sbf_inverse ~window ~frame (demand r) in
+      if r' = r then Some (r + jitter) else fix r' in
+  fix (sbf_inverse ~window ~frame t.wcet)
+;;
+
+(* Processor demand of the jobs of members with deadline in an
+   interval of length t; with a release jitter, they may be released
+   before it. *)
+let dbf ~jitter tasks members t =
+  List.fold_left (fun acc j ->
+      let tj = tasks.(j) in
+      if t + jitter < tj.deadline then acc
+      else acc + ((t + jitter - tj.deadline) / tj.period + 1) * tj.wcet) 0 members
+;;
+
+(* Processor demand analysis for EDF_SCHEDULING: dbf t <= sbf t for
+   the absolute deadlines t up to a bound, after which it holds as the
+   utilization u is below the bandwidth alpha of the partition. Returns
+   the first violation found. *)
+let edf_violation ~jitter ~window ~frame tasks members =
+  let util t = float t.wcet /. float t.period in
+  let u = List.fold_left (fun acc j -> acc +. util tasks.(j)) 0. members in
+  let alpha = float window /. float frame in
+  if u > alpha then Some (Printf.sprintf "the utilization %.3f exceeds %.3f" u alpha)
+  else begin
+    let dmax = List.fold_left (fun acc j -> max acc tasks.(j).deadline) 0 members in
+    let hyper = List.fold_left (fun acc j -> lcm acc tasks.(j).period) frame members in
+    let bound =
+      if u < alpha then begin
+        let slack = List.fold_left (fun acc j ->
+            let t = tasks.(j) in acc +. util t *. float (t.period - t.deadline + jitter)) 0. members in
+        let delta = float (frame - window) in
+        min (dmax + hyper) (int_of_float (ceil ((slack +. alpha *. delta) /. (alpha -. u))))
+      end else dmax + hyper in
+    let violation = ref None in
+    List.iter (fun j ->
+        let d = ref (max 0 (tasks.(j).deadline - jitter)) in
+        while !violation = None && !d <= bound do
+          if dbf ~jitter tasks members !d > sbf ~window ~frame !d then
+            violation := Some (Printf.sprintf "the demand exceeds the supply at %d us" (!d / us));
+          d := !d + tasks.(j).period
+        done) members;
+    !violation
+  end
+;;
+
+type analysis = {
+  (* FP worst-case response times, None if a deadline can be missed. *)
+  response : int option array;
+  (* Why EDF can miss a deadline, if it can. *)
+  edf_miss : string option;
+};;
+
+(* Analyse the task set on one processor, or with each partition
+   in its windows. *)
+let analyse ~jitter tasks prios nb_partitions ~partitioned =
+  let n = Array.length tasks in
+  let groups = if partitioned then nb_partitions else 1 in
+  let window = if partitioned then window_length else 1 in
+  let frame = if partitioned then nb_partitions * window_length else 1 in
+  let response = Array.make n None in
+  let edf_miss = ref None in
+  for p = 0 to groups - 1 do
+    let members = List.filter (fun i -> i mod groups = p) (List.init n (fun i -> i)) in
+    List.iter (fun i -> response.(i) <- response_time ~jitter ~window ~frame tasks prios members i) members;
+    match edf_violation ~jitter ~window ~frame tasks members with
+    | Some msg when !edf_miss = None ->
+      edf_miss := Some (if partitioned then Printf.sprintf "partition %d: %s" p msg else msg)
+    | _ -> ()
+  done;
+  { response; edf_miss = !edf_miss }
+;;
+
+let fp_miss a =
+  let miss = ref None in
+  Array.iteri (fun i r ->
+      if r = None && !miss = None then
+        miss := Some (Printf.sprintf "task %d can miss its deadline" i)) a.response;
+  !miss
+;;
+
+(* Fail the build of an unschedulable configuration. ticked is the
+   verdict (flat, partitioned) with the periodic tick of the PIT, and
+   exact with the other timers. *)
+let emit_errors sched ticked exact =
+  let error suffix = function
+    | Some msg -> pf "#error \"%s: %s%s (see system_desc_gen -report)\"\n" sched msg suffix
+    | None -> () in
+  let errors suffix (flat, partitioned) =
+    ps "#ifdef TIME_PARTITIONING\n";
+    error suffix partitioned;
+    ps "#else\n";
+    error suffix flat;
+    ps "#endif\n" in
+  pf "#ifdef %s\n" sched;
+  ps "#if defined(PIT_TIMER) && !defined(TIMER_TICKLESS)\n";
+  errors " with the jitter of the tick" ticked;
+  ps "#else\n";
+  errors "" exact;
+  ps "#endif\n";
+  ps "#endif\n";
+;;
+
+(* Simulate the preemptive EDF scheduling of the tasks over one
+   hyperperiod. Returns the hyperperiod and the list of dispatches
+   (date, task), task being -1 when idle. Fails if a deadline is
+   missed, or if a job is not complete at the end of the hyperperiod
+   (so that the table can be repeated). *)
+let cyclic_schedule tasks =
+  let n = Array.length tasks in
+  let hyper = Array.fold_left (fun acc t -> lcm acc t.period) 1 tasks in
+  (* Release of the next job; remaining work and deadline of the
+     current one. *)
+  let release = Array.map (fun t -> t.offset) tasks in
+  let remaining = Array.make n 0 in
+  let deadline = Array.make n 0 in
+  let table = ref [] in
+  let last = ref (-2) in
+  let t = ref 0 in
+  while !t < hyper do
+    for i = 0 to n - 1 do
+      if release.(i) <= !t then begin
+        if remaining.(i) > 0 then
+          failwith (Printf.sprintf "Task %d misses its deadline at %d" i !t);
+        remaining.(i) <- tasks.(i).wcet;
+        deadline.(i) <- release.(i) + tasks.(i).deadline;
+        release.(i) <- release.(i) + tasks.(i).period
+      end
+    done;
+    (* The earliest deadline goes first. *)
+    let cur = ref (-1) in
+    for i = n - 1 downto 0 do
+      if remaining.(i) > 0 && (!cur < 0 || deadline.(i) <= deadline.(!cur)) then cur := i
+    done;
+    let next = ref hyper in
+    Array.iter (fun r -> if r < !next then next := r) release;
+    if !cur >= 0 && !t + remaining.(!cur) < !next then next := !t + remaining.(!cur);
+    if !cur <> !last then begin table := (!t, !cur) :: !table; last := !cur end;
+    if !cur >= 0 then begin
+      remaining.(!cur) <- remaining.(!cur) - (!next - !t);
+      if remaining.(!cur) = 0 && !next > deadline.(!cur) then
+        failwith (Printf.sprintf "Task %d misses its deadline at %d" !cur deadline.(!cur))
+    end;
+    t := !next
+  done;
+  Array.iteri (fun i r ->
+      if r > 0 then
+        failwith (Printf.sprintf "Task %d is not complete at the end of the hyperperiod" i))
+    remaining;
+  (hyper, List.rev !table)
+;;
+
+let rec index x = function
+  | [] -> raise Not_found
+  | y :: l -> if x = y then 0 else 1 + index x l
+;;
+
+let doit tasks nb_partitions =
+  let n = Array.length tasks in
+  let prios = assign_priorities tasks in
   ps "#include \"user_tasks.h\"                                           \n";
   ps "                                                                    \n";
   ps "#define STRING(x) #x                                                \n";
   ps "#define XSTRING(x) STRING(x)                                        \n";
   ps "                                                                    \n";
   ps "#define INCBIN(name, file)                                        \\\n";
-  ps "    asm(\".section .data.task\\n\"                                \\\n";
+  ps "    asm(\".pushsection .data.task\\n\"                            \\\n";
   ps "            \".global \" XSTRING(name) \"_begin\\n\"              \\\n";
   ps "            \".type \" XSTRING(name) \"_begin, @object\\n\"       \\\n";
   ps "            \".balign 16\\n\"                                     \\\n";
@@ -20,13 +296,24 @@ let doit n =
   ps "            \".balign 1\\n\"                                      \\\n";
   ps "            XSTRING(name) \"_end:\\n\"                            \\\n";
   ps "            \".byte 0\\n\"                                        \\\n";
+  ps "            \".popsection\\n\"                                    \\\n";
   ps "    );                                                            \\\n";
   ps "    extern __attribute__((aligned(16))) char name ## _begin[];    \\\n";
   ps "    extern char name ## _end[];                                   \\\n";
   ps "                                                                    \n";
+  (* The basic tasks with the same priority in a partition can share an
+     image, and thus a stack. *)
+  let levels = List.sort_uniq compare (List.init n (fun i -> (i mod nb_partitions, prios.(i)))) in
+  let level i = index (i mod nb_partitions, prios.(i)) levels in
+  ps "#ifdef BASIC_TASKS                                                  \n";
+  for g = 0 to List.length levels - 1 do
+  pf "INCBIN(basic%d, \"task0.bin\")                                      \n" g;
+  done;
+  ps "#else                                                               \n";
   for i = 0 to n - 1 do
   pf "INCBIN(task%d, \"task0.bin\")                                       \n" i;
   done;
+  ps "#endif                                                              \n";
   ps "#include \"terminal.h\"           /* For now. */                    \n"; 
   ps "#include \"user_tasks.h\"                                           \n";
   ps "#include \"high_level.h\"                                           \n";
@@ -42,21 +329,78 @@ let doit n =
   pf "  [%d] = {                                                          \n" i;
   pf "     .context = &system_contexts[%d],                               \n" i;
   ps "     .start_pc = 0,                                                 \n";
+  ps "#ifdef BASIC_TASKS                                                  \n";
+  pf "     .task_begin = basic%d_begin,                                   \n" (level i);
+  pf "     .task_end = basic%d_end,                                       \n" (level i);
+  pf "     .period = %dULL,                                               \n" tasks.(i).period;
+  pf "     .relative_deadline = %dULL,                                    \n" tasks.(i).deadline;
+  ps "#else                                                               \n";
   pf "     .task_begin = task%d_begin,                                    \n" i;
   pf "     .task_end = task%d_end,                                        \n" i;
+  ps "#endif                                                              \n";
   ps "#ifdef FP_SCHEDULING                                                \n";
-  ps "     .priority = 10,                                                \n";
+  pf "     .priority = %d,                                                \n" prios.(i);
+  ps "#endif                                                              \n";
+  ps "#ifdef STRIDE_SCHEDULING                                            \n";
+  pf "     .tickets = %d,                                                 \n" (100 * (1 + i mod 3));
+  ps "#endif                                                              \n";
+  ps "#ifdef TIME_PARTITIONING                                            \n";
+  pf "     .partition = %d,                                               \n" (i mod nb_partitions);
+  ps "#endif                                                              \n";
+  ps "#ifdef CYCLIC_SCHEDULING                                            \n";
+  pf "     .offset = %dULL,                                               \n" tasks.(i).offset;
+  ps "#endif                                                              \n";
+  ps "#ifdef CBS_RESERVATIONS                                             \n";
+  pf "     .cbs_budget = %dULL,                                           \n" tasks.(i).wcet;
+  pf "     .cbs_period = %dULL,                                           \n" tasks.(i).period;
   ps "#endif                                                              \n";
   ps "  },                                                                \n";
   done;
   ps "};                                                                  \n";
   ps "                                                                    \n";
   ps "                                                                    \n";
+  let verdicts jitter miss =
+    (miss (analyse ~jitter tasks prios nb_partitions ~partitioned:false),
+     miss (analyse ~jitter tasks prios nb_partitions ~partitioned:true)) in
+  let edf a = a.edf_miss in
+  emit_errors "FP_SCHEDULING" (verdicts tick_jitter fp_miss) (verdicts 0 fp_miss);
+  emit_errors "EDF_SCHEDULING" (verdicts tick_jitter edf) (verdicts 0 edf);
+  ps "                                                                    \n";
   ps "static struct context *ready_heap_array[NB_TASKS];                  \n";
   ps "static struct context *waiting_heap_array[NB_TASKS];                \n";
   ps "                                                                    \n";
   ps "static struct context idle_ctx_array[NUM_CPUS];                     \n";
   ps "                                                                    \n";
+  ps "#ifdef MUTEXES                                                      \n";
+  pf "static mutex_t mutexes[%d];                                         \n" nb_mutexes;
+  ps "#endif                                                              \n";
+  ps "                                                                    \n";
+  ps "#ifdef TIME_PARTITIONING                                            \n";
+  ps "/* Each partition gets a window of the same length. */              \n";
+  ps "static const struct partition_window windows[] = {                  \n";
+  for i = 0 to nb_partitions - 1 do
+  pf "  [%d] = { .offset = %dULL, .duration = %dULL, .partition = %d },   \n"
+    i (i * window_length) window_length i;
+  done;
+  ps "};                                                                  \n";
+  ps "#endif                                                              \n";
+  ps "                                                                    \n";
+  let schedule = try Ok (cyclic_schedule tasks) with Failure msg -> Error msg in
+  ps "#ifdef CYCLIC_SCHEDULING                                            \n";
+  (match schedule with
+   | Error msg -> pf "#error \"%s\"\n" msg
+   | Ok (hyper, table) ->
+  ps "static const struct dispatch_entry dispatch_table[] = {             \n";
+  List.iter (fun (date, task) ->
+    if task < 0 then
+  pf "  { .date = %dULL, .context = 0 },                                  \n" date
+    else
+  pf "  { .date = %dULL, .context = &system_contexts[%d] },               \n" date task)
+    table;
+  pf "  { .date = %dULL, .context = 0 },                                  \n" hyper;
+  ps "};                                                                  \n");
+  ps "#endif                                                              \n";
+  ps "                                                                    \n";
   ps "const struct user_tasks_image user_tasks_image = {                  \n";
   pf "  .nb_tasks = NB_TASKS,                                             \n";
   ps "  .tasks = tasks,                                                   \n";
@@ -64,9 +408,99 @@ let doit n =
   ps "  .ready_heap_array = &ready_heap_array[0],                         \n";
   ps "  .waiting_heap_array = &waiting_heap_array[0],                     \n";
   ps "  .idle_ctx_array = &idle_ctx_array[0],                             \n";
+  ps "#ifdef TIME_PARTITIONING                                            \n";
+  pf "  .nb_partitions = %d,                                              \n" nb_partitions;
+  pf "  .nb_windows = %d,                                                 \n" nb_partitions;
+  ps "  .windows = windows,                                               \n";
+  pf "  .major_frame = %dULL,                                             \n" (nb_partitions * window_length);
+  ps "#endif                                                              \n";
+  ps "#ifdef MUTEXES                                                      \n";
+  pf "  .nb_mutexes = %d,                                                 \n" nb_mutexes;
+  ps "  .mutexes = mutexes,                                               \n";
+  ps "#endif                                                              \n";
+  (match schedule with
+   | Error _ -> ()
+   | Ok (hyper, table) ->
+  ps "#ifdef CYCLIC_SCHEDULING                                            \n";
+  pf "  .nb_dispatch = %d,                                                \n" (List.length table);
+  ps "  .dispatch_table = dispatch_table,                                 \n";
+  pf "  .hyperperiod = %dULL,                                             \n" hyper;
+  ps "#endif                                                              \n");
   ps "};                                                                  \n";
 ;;
 
-let num = Stdlib.int_of_string @@ Sys.argv.(1) in
-doit num;;
-  
+(* The constants of the description, for the specialized build (see
+   SYSTEM_DESC_CONSTANTS in high_level.h). Must agree with doit. *)
+let header tasks nb_partitions =
+  let prios = assign_priorities tasks in
+  ps "/* Generated by system_desc_gen. */                                 \n";
+  pf "#define SYSTEM_NB_TASKS %d                                          \n" (Array.length tasks);
+  pf "#define SYSTEM_NB_PARTITIONS %d                                     \n" nb_partitions;
+  (* Task i is in partition i mod nb_partitions (see doit). *)
+  let n = Array.length tasks in
+  ps "#define SYSTEM_PARTITION_NB_TASKS {";
+  for p = 0 to nb_partitions - 1 do
+    pf "%s%d" (if p = 0 then " " else ", ") ((n - p + nb_partitions - 1) / nb_partitions)
+  done;
+  ps " }\n";
+  ps "#define SYSTEM_TASK_PRIORITIES {";
+  Array.iteri (fun i p -> pf "%s%d" (if i = 0 then " " else ", ") p) prios;
+  ps " }\n";
+;;
+
+(* The parameters of the tasks and the results of the analysis. *)
+let report tasks nb_partitions =
+  let prios = assign_priorities tasks in
+  let flat = analyse ~jitter:0 tasks prios nb_partitions ~partitioned:false in
+  let part = analyse ~jitter:0 tasks prios nb_partitions ~partitioned:true in
+  let tflat = analyse ~jitter:tick_jitter tasks prios nb_partitions ~partitioned:false in
+  let tpart = analyse ~jitter:tick_jitter tasks prios nb_partitions ~partitioned:true in
+  let u = Array.fold_left (fun acc t -> acc +. float t.wcet /. float t.period) 0. tasks in
+  pf "%d tasks, utilization %.3f. Times are in us.\n" (Array.length tasks) u;
+  pf "Under TIME_PARTITIONING, each of the %d partitions runs %d every %d.\n"
+    nb_partitions (window_length / us) (nb_partitions * window_length / us);
+  pf "With the periodic tick of the PIT, the release jitter is %d.\n\n" (tick_jitter / us);
+  pf "%4s %9s %9s %9s %8s %9s %11s %11s %11s %11s\n"
+    "task" "period" "wcet" "deadline" "priority" "partition" "FP wcrt" "partitioned"
+    "with tick" "partitioned";
+  let wcrt = function Some r -> string_of_int (r / us) | None -> "miss" in
+  Array.iteri (fun i t ->
+      pf "%4d %9d %9d %9d %8d %9d %11s %11s %11s %11s\n"
+        i (t.period / us) (t.wcet / us) (t.deadline / us) prios.(i) (i mod nb_partitions)
+        (wcrt flat.response.(i)) (wcrt part.response.(i))
+        (wcrt tflat.response.(i)) (wcrt tpart.response.(i))) tasks;
+  let verdict = function None -> "schedulable" | Some msg -> msg in
+  pf "\nEDF: %s.\nEDF, partitioned: %s.\n" (verdict flat.edf_miss) (verdict part.edf_miss);
+  pf "EDF with tick: %s.\nEDF with tick, partitioned: %s.\n"
+    (verdict tflat.edf_miss) (verdict tpart.edf_miss);
+;;
+
+(* Usage: system_desc_gen [-header | -report] [-tasks file] nb_tasks [nb_partitions]
+   The task set is read from file if given (it must have nb_tasks
+   tasks), and is the default one otherwise. *)
+let mode = ref `Desc in
+let file = ref None in
+let args = ref [] in
+let rec parse = function
+  | "-header" :: l -> mode := `Header; parse l
+  | "-report" :: l -> mode := `Report; parse l
+  | "-tasks" :: f :: l -> file := Some f; parse l
+  | arg :: l -> args := !args @ [arg]; parse l
+  | [] -> () in
+parse (List.tl (Array.to_list Sys.argv));
+let (num, nb_partitions) = match !args with
+  | [n] -> (Stdlib.int_of_string n, 1)
+  | [n; p] -> (Stdlib.int_of_string n, Stdlib.int_of_string p)
+  | _ -> failwith "Usage: system_desc_gen [-header | -report] [-tasks file] nb_tasks [nb_partitions]" in
+let tasks = match !file with
+  | None -> Array.init num (default_task num)
+  | Some f ->
+    let tasks = read_tasks f in
+    if Array.length tasks <> num then
+      failwith (Printf.sprintf "%s has %d tasks, not %d" f (Array.length tasks) num);
+    tasks in
+Array.iteri check_task tasks;
+match !mode with
+| `Desc -> doit tasks nb_partitions
+| `Header -> header tasks nb_partitions
+| `Report -> report tasks nb_partitions;;
@@ -12,6 +12,22 @@
 /* The tasks setup their stack themselves, in assembly. */
 static char user_stack[USER_STACK_SIZE] __attribute__((used, aligned(16)));
 
+#ifdef BASIC_TASKS
+/* Each job starts here, on an empty stack, with the task index in
+   eax. The stack is shared by all the tasks using this image. */
+asm("\
+.global _start\n\
+.type _start, @function\n\
+_start:\n\
+        /* Setup the stack */ \n\
+	mov $(user_stack + " XSTRING(USER_STACK_SIZE) "), %esp\n\
+        call job_start\n\
+        jmp user_error_infinite_loop\n\
+/* setup size of _start symbol. */\n\
+.size _start, . - _start\n\
+");
+#else
+/* The task index is in eax. */
 asm("\
 .global _start\n\
 .type _start, @function\n\
@@ -23,6 +39,7 @@ _start:\n\
 /* setup size of _start symbol. */\n\
 .size _start, . - _start\n\
 ");
+#endif
 
 asm("\
 .global user_error_infinite_loop\n\
@@ -33,14 +50,37 @@ user_error_infinite_loop:\n\
 	jmp 1b\n\
 ");
 
-void __attribute__((used))
-test_userspace(void)  {
+#ifdef BASIC_TASKS
+/* The job of a basic task just returns when it is done. */
+static void
+job(unsigned int task){
+  printf("task%d: job\n", task);
+}
+
+void __attribute__((used,regparm(1),noreturn))
+job_start(unsigned int task){
+  job(task);
+  job_end();
+  __builtin_unreachable();
+}
+#endif
+
+void __attribute__((used,regparm(1)))
+test_userspace(unsigned int task)  {
+  (void) task;
   putchar('0' + TASK_NUMBER);
   printf(" says hello %d\n", TASK_NUMBER);
   int i = 0;
   while(1){
     i++;
+#ifdef MUTEXES
+    /* Keep the lines whole. */
+    mutex_lock(0, task);
+#endif
     printf("task" XSTRING(TASK_NUMBER) ": i=%d\n", i);
+#ifdef MUTEXES
+    mutex_unlock(0, task);
+#endif
     yield((TASK_NUMBER + 2)*1000000000ULL,1000000000ULL);
     /* yield(3000000ULL,3000000ULL);     */
   }
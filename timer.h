@@ -10,7 +10,13 @@ typedef uint64_t date_t;
 /* A difference between 2 dates. */
 typedef uint64_t duration_t;
 
-#define DATE_FAR_AWAY 0xFFFFFFFFFFFFFFFFULL;
+#define DATE_FAR_AWAY 0xFFFFFFFFFFFFFFFFULL
+
+/* Duration between two timer interrupts. The kernel is woken only on
+   these ticks, so timer_wake_at is precise up to a tick. With
+   TIMER_TICKLESS, there is no periodic interrupt, but this is still
+   the granularity of the timing wheel. */
+extern const duration_t timer_tick;
 
 /* Initialize the timer. */
 void timer_init(void);
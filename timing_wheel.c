@@ -0,0 +1,173 @@
+#include <stddef.h>
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* A hierarchical timing wheel for the waiting tasks, keyed on the
+   timer tick (the wakeup date of a task is rounded up to the next
+   tick).
+
+   There are TIMING_WHEEL_LEVELS levels of 64 slots. A task that must
+   wake in less than 64 ticks goes to level 0, in the slot numbered by
+   the low 6 bits of its wakeup tick. A task that must wake in less
+   than 64^2 ticks goes to level 1, in the slot numbered by the next 6
+   bits, etc. Each slot is an intrusive singly-linked list, so
+   insertion is in O(1). Nothing cancels a wakeup: a task leaves the
+   wheel only when its slot expires.
+
+   When the tick reaches the beginning of the period covered by a slot
+   of level l > 0, the slot is "cascaded": its tasks are put again in
+   the wheel, at a lower level. A level 0 slot is expired as a whole:
+   all its tasks wake at the current tick.
+
+   A bitmap per level tells which slots are non-empty. It allows to
+   jump directly to the next tick where something happens, and to
+   compute the next date at which the timer must wake. */
+
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_BITS)
+/* Tasks that wake later than this are put in the last level, and
+   cascaded as many times as needed. */
+#define TIMING_WHEEL_MAX_DELTA ((1ULL << (TIMING_WHEEL_BITS * TIMING_WHEEL_LEVELS)) - 1)
+
+typedef uint64_t tick_t;
+
+struct timing_wheel {
+  /* All the ticks up to now have been processed. */
+  tick_t now;
+  uint64_t nonempty[TIMING_WHEEL_LEVELS];
+  struct context *slot[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+};
+
+static inline tick_t timing_wheel_tick_of_date(date_t date){
+  /* Round up; avoid overflow with DATE_FAR_AWAY. */
+  tick_t tick = date / timer_tick;
+  if(tick * timer_tick != date) tick++;
+  return tick;
+}
+
+static inline date_t timing_wheel_date_of_tick(tick_t tick){
+  return tick * timer_tick;
+}
+
+/* Index of the least significant bit set; x must not be 0. Done on
+   two words to avoid a call to libgcc on 32-bit x86. */
+static inline unsigned int timing_wheel_ctz(uint64_t x){
+  uint32_t low = (uint32_t) x;
+  if(low) return __builtin_ctz(low);
+  return 32 + __builtin_ctz((uint32_t) (x >> 32));
+}
+
+static inline unsigned int timing_wheel_shift(unsigned int level){
+  return TIMING_WHEEL_BITS * level;
+}
+
+/* Put ctx in the slot corresponding to its wakeup tick, which must be
+   at least w->now. */
+static inline void timing_wheel_place(struct timing_wheel *w, struct context *ctx){
+  tick_t tick = ctx->sched_context.wheel_tick;
+  tick_t delta = tick - w->now;
+  if(delta > TIMING_WHEEL_MAX_DELTA){
+    delta = TIMING_WHEEL_MAX_DELTA;
+    tick = w->now + delta;
+  }
+  unsigned int level = 0;
+  while(delta >> timing_wheel_shift(level + 1)) level++;
+  unsigned int idx = (tick >> timing_wheel_shift(level)) & (TIMING_WHEEL_SLOTS - 1);
+
+  struct context **head = &w->slot[level][idx];
+  ctx->sched_context.wheel_next = *head;
+  *head = ctx;
+  w->nonempty[level] |= 1ULL << idx;
+}
+
+/* Insert ctx, according to its wakeup_date. If the date has passed,
+   it will wake on the next tick. */
+static inline void timing_wheel_insert(struct timing_wheel *w, struct context *ctx){
+  tick_t tick = timing_wheel_tick_of_date(ctx->sched_context.wakeup_date);
+  if(tick <= w->now) tick = w->now + 1;
+  ctx->sched_context.wheel_tick = tick;
+  timing_wheel_place(w, ctx);
+}
+
+/* Detach the list of a slot, and return it. */
+static inline struct context *timing_wheel_take_slot(struct timing_wheel *w,
+                                                     unsigned int level, unsigned int idx){
+  struct context *list = w->slot[level][idx];
+  w->slot[level][idx] = NULL;
+  w->nonempty[level] &= ~(1ULL << idx);
+  return list;
+}
+
+/* The next tick after w->now at which a slot must be cascaded or
+   expired, or 0 if the wheel is empty. */
+static inline tick_t timing_wheel_next_event(struct timing_wheel const *w){
+  tick_t best = 0;
+  for(unsigned int level = 0; level < TIMING_WHEEL_LEVELS; level++){
+    uint64_t map = w->nonempty[level];
+    if(map == 0) continue;
+    unsigned int shift = timing_wheel_shift(level);
+    unsigned int cur = (w->now >> shift) & (TIMING_WHEEL_SLOTS - 1);
+    /* Slots are in time order starting from cur + 1 (cur itself being
+       the last one, a full turn later). */
+    unsigned int rot = (cur + 1) & (TIMING_WHEEL_SLOTS - 1);
+    uint64_t rotated = (map >> rot) | (rot ? map << (TIMING_WHEEL_SLOTS - rot) : 0);
+    unsigned int idx = (rot + timing_wheel_ctz(rotated)) & (TIMING_WHEEL_SLOTS - 1);
+    tick_t turn = (w->now >> (shift + TIMING_WHEEL_BITS)) << (shift + TIMING_WHEEL_BITS);
+    tick_t tick = turn + ((tick_t) idx << shift);
+    if(tick <= w->now) tick += 1ULL << (shift + TIMING_WHEEL_BITS);
+    if(best == 0 || tick < best) best = tick;
+  }
+  return best;
+}
+
+/* The date at which the timer should next wake the kernel. */
+static inline date_t timing_wheel_next_date(struct timing_wheel const *w){
+  tick_t tick = timing_wheel_next_event(w);
+  if(tick == 0) return DATE_FAR_AWAY;
+  return timing_wheel_date_of_tick(tick);
+}
+
+/* Process all the ticks up to curtime: cascade the slots whose period
+   begins, and call expire on each task whose wakeup date is reached.
+   Ticks where nothing happens are skipped. */
+static inline void timing_wheel_advance(struct timing_wheel *w, date_t curtime,
+                                        void (*expire)(struct context *)){
+  tick_t target = curtime / timer_tick;
+  while(1){
+    tick_t tick = timing_wheel_next_event(w);
+    if(tick == 0 || tick > target) break;
+    w->now = tick;
+
+    /* Cascade the higher levels first, as they may fill the lower ones. */
+    unsigned int top = 0;
+    while(top + 1 < TIMING_WHEEL_LEVELS
+          && (tick & ((1ULL << timing_wheel_shift(top + 1)) - 1)) == 0) top++;
+    for(unsigned int level = top; level > 0; level--){
+      unsigned int idx = (tick >> timing_wheel_shift(level)) & (TIMING_WHEEL_SLOTS - 1);
+      struct context *ctx = timing_wheel_take_slot(w, level, idx);
+      while(ctx){
+        struct context *next = ctx->sched_context.wheel_next;
+        timing_wheel_place(w, ctx);
+        ctx = next;
+      }
+    }
+
+    struct context *ctx = timing_wheel_take_slot(w, 0, tick & (TIMING_WHEEL_SLOTS - 1));
+    while(ctx){
+      struct context *next = ctx->sched_context.wheel_next;
+      expire(ctx);
+      ctx = next;
+    }
+  }
+  if(target > w->now) w->now = target;
+}
+
+static inline void timing_wheel_init(struct timing_wheel *w){
+  w->now = 0;
+  for(unsigned int level = 0; level < TIMING_WHEEL_LEVELS; level++){
+    w->nonempty[level] = 0;
+    for(unsigned int i = 0; i < TIMING_WHEEL_SLOTS; i++) w->slot[level][i] = NULL;
+  }
+}
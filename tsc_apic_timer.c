@@ -0,0 +1,149 @@
+/* Timer using the TSC as clock, and the local APIC timer for the
+   interrupts.
+
+   The TSC is read without interrupt, at the resolution of the
+   processor clock. Its frequency is calibrated against the PIT at
+   boot; it should be invariant, i.e. not change with the power
+   states, which is checked.
+
+   The local APIC timer is used in TSC-deadline mode if the processor
+   has it: the interrupt is raised when the TSC reaches a value.
+   Else, it is used in one-shot mode, counting down at a frequency
+   also calibrated against the PIT; dates too far are reached with a
+   chain of shots. */
+
+#include "timer.h"
+#include "config.h"
+#include <stdint.h>
+#include "low_level.h"
+#include "high_level.h"
+#include "terminal.h"
+#include "error.h"
+#include "x86/port.h"
+#include "x86/pic.h"
+#include "x86/cpu.h"
+#include "x86/apic.h"
+#include "clock_scale.h"
+
+#define _1_NANOSECOND 1ULL
+#define _1_MICROSECOND (1000ULL * _1_NANOSECOND)
+#define _1_MILLISECOND (1000ULL * _1_MICROSECOND)
+#define _1_SECOND (1000ULL * _1_MILLISECOND)
+
+#define PIT_HZ 1193182               /* The PIT fixed frequency */
+/* The length of the calibration, in PIT cycles (about 50ms). */
+#define CALIBRATION_CYCLES 59659
+
+/* There is no tick; this is only the granularity of the timing
+   wheel. */
+const duration_t timer_tick = _1_MILLISECOND;
+
+/* The 8259 is not used; all its IRQs are masked. */
+void init_pic(void){
+  pic_init(TIMER_INTERRUPT_NUMBER, SPURIOUS_TIMER_INTERRUPT_NUMBER, 0xFF, 0xFF);
+}
+
+void init_apic(void){
+  struct cpuid const id = cpuid(1);
+  if(!(id.edx & CPUID_1_EDX_APIC)) fatal("No local APIC\n");
+  if(!(id.edx & CPUID_1_EDX_TSC)) fatal("No TSC\n");
+  lapic_enable(APIC_SPURIOUS_INTERRUPT_NUMBER);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | TIMER_INTERRUPT_NUMBER);
+}
+
+static uint64_t tsc_base;       /* The TSC at date 0. */
+static struct scale tsc_to_ns;
+static struct scale ns_to_tsc;
+static struct scale ns_to_apic; /* Without TSC-deadline. */
+static _Bool tsc_deadline;
+
+static uint64_t next_wake_date = DATE_FAR_AWAY;
+
+date_t timer_current_time(void){
+  return scale(rdtsc() - tsc_base, tsc_to_ns);
+}
+
+/* Program the interrupt for next_wake_date. */
+static void timer_arm(void){
+  if(tsc_deadline){
+    /* Rounded up, so that the interrupt does not come too early. A
+       date already past raises it at once. */
+    wrmsr(MSR_IA32_TSC_DEADLINE, tsc_base + scale(next_wake_date, ns_to_tsc) + 1);
+    return;
+  }
+  date_t const now = timer_current_time();
+  uint64_t count = 1;
+  if(next_wake_date > now) count = scale(next_wake_date - now, ns_to_apic) + 1;
+  /* If this does not reach the date, the handler chains another shot. */
+  if(count > 0xFFFFFFFFULL) count = 0xFFFFFFFFULL;
+  lapic_write(LAPIC_TIMER_INITIAL_COUNT, count);
+}
+
+static void timer_disarm(void){
+  if(tsc_deadline) wrmsr(MSR_IA32_TSC_DEADLINE, 0);
+  else lapic_write(LAPIC_TIMER_INITIAL_COUNT, 0);
+}
+
+void timer_wake_at(date_t next_wakeup){
+  if(next_wakeup == next_wake_date) return;
+  next_wake_date = next_wakeup;
+  if(next_wakeup == DATE_FAR_AWAY) timer_disarm();
+  else timer_arm();
+}
+
+void timer_dont_wake(void){
+  timer_wake_at(DATE_FAR_AWAY);
+}
+
+/* Count the TSC and APIC timer cycles during CALIBRATION_CYCLES of
+   the PIT, polled in mode 0; the IRQ is masked. */
+static void calibrate(uint64_t *tsc_hz, uint64_t *apic_hz){
+  lapic_write(LAPIC_TIMER_DIVIDE, 0xB);     /* Divide by 1. */
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONE_SHOT | TIMER_INTERRUPT_NUMBER);
+  outb(0x43, 0x30);             /* Channel 0, low then high byte, mode 0. */
+  outb(0x40, CALIBRATION_CYCLES & 0xFF);
+  outb(0x40, CALIBRATION_CYCLES >> 8);
+  lapic_write(LAPIC_TIMER_INITIAL_COUNT, 0xFFFFFFFF);
+  uint64_t const tsc_start = rdtsc();
+  /* Read-back the status of channel 0 until OUT goes high. */
+  do outb(0x43, 0xE2); while(!(inb(0x40) & 0x80));
+  uint64_t const tsc_end = rdtsc();
+  uint32_t const apic_cycles = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT_COUNT);
+  lapic_write(LAPIC_TIMER_INITIAL_COUNT, 0);
+  *tsc_hz = ((tsc_end - tsc_start) * PIT_HZ) / CALIBRATION_CYCLES;
+  *apic_hz = ((uint64_t) apic_cycles * PIT_HZ) / CALIBRATION_CYCLES;
+}
+
+void timer_init(void){
+  uint64_t tsc_hz, apic_hz;
+  calibrate(&tsc_hz, &apic_hz);
+  terminal_print("TSC at %d kHz\n", (uint32_t) (tsc_hz / 1000));
+
+  if(cpuid(0x80000000).eax < 0x80000007
+     || !(cpuid(0x80000007).edx & CPUID_80000007_EDX_INVARIANT_TSC))
+    terminal_writestring("Warning: the TSC is not invariant\n");
+
+  tsc_to_ns = scale_init(_1_SECOND, tsc_hz);
+  ns_to_tsc = scale_init(tsc_hz, _1_SECOND);
+  ns_to_apic = scale_init(apic_hz, _1_SECOND);
+
+  tsc_deadline = (cpuid(1).ecx & CPUID_1_ECX_TSC_DEADLINE) != 0;
+  lapic_write(LAPIC_LVT_TIMER, TIMER_INTERRUPT_NUMBER |
+              (tsc_deadline ? LAPIC_TIMER_TSC_DEADLINE : LAPIC_TIMER_ONE_SHOT));
+  tsc_base = rdtsc();
+}
+
+void __attribute__((regparm(3),noreturn,used))
+timer_interrupt_handler(struct hw_context *cur_hw_ctx){
+  lapic_eoi();
+  date_t const cur = timer_current_time();
+  if(cur >= next_wake_date){
+    /* The timer is disarmed once it has fired. */
+    next_wake_date = DATE_FAR_AWAY;
+    high_level_timer_interrupt_handler(cur_hw_ctx, cur);
+  }
+  /* The end of a chained shot; else, the high level has armed the
+     timer. */
+  else if(next_wake_date != DATE_FAR_AWAY) timer_arm();
+  hw_context_switch(cur_hw_ctx);
+}
@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* Interrupts delivered to user tasks. A task bound to an IRQ line
+   (in its description) waits for it with wait_irq, which unmasks the
+   line and blocks the task. When the interrupt is raised, the kernel
+   masks the line again and acknowledges it; the task is then released
+   as a sporadic job, at its own priority, and with the deadline
+   irq_deadline after its release.
+
+   If irq_min_interarrival is not 0, the releases are at least this
+   far apart: an earlier interrupt puts the task in the waiting queue
+   until the next release is allowed.
+
+   priority_scheduler.c includes this file. The includer must provide
+   ready_queue_add, waiting_add, arm_timer, deadline_release,
+   deadline_job_end, cbs_release, cbs_tick and cbs_stop. */
+
+#ifdef USER_INTERRUPTS
+
+#define NB_IRQS 16
+
+static struct user_irq {
+  struct context *task;         /* Bound to the IRQ, or NULL. */
+  _Bool waiting;                /* The task is blocked in wait_irq. */
+  date_t next_release;          /* The earliest allowed. */
+} user_irq[NB_IRQS];
+
+struct context *sched_wait_irq(struct context *ctx){
+  unsigned int const irq = user_tasks_image.tasks[context_index(ctx)].irq;
+  if(irq == 0) return ctx;
+  cbs_stop(ctx);
+  deadline_job_end(ctx);
+  user_irq[irq].waiting = 1;
+  hw_irq_enable(irq);
+  return sched_choose_next();
+}
+
+struct context *sched_irq(struct context *ctx, unsigned int irq){
+  struct user_irq *u = &user_irq[irq];
+  date_t const now = timer_current_time();
+  /* Charge the running task before the preemption check, which
+     restarts its budget accounting. */
+  cbs_tick(now);
+  if(u->waiting){
+    struct context *task = u->task;
+    struct task_description const *desc = &user_tasks_image.tasks[context_index(task)];
+    date_t const release = now < u->next_release ? u->next_release : now;
+    u->waiting = 0;
+    u->next_release = release + desc->irq_min_interarrival;
+    task->sched_context.wakeup_date = release;
+#if defined(EDF_SCHEDULING) || defined(DEADLINE_MONITORING)
+    task->sched_context.deadline = release + desc->irq_deadline;
+#endif
+    if(release > now){
+      /* Too early: released by the timer. */
+      waiting_add(task);
+      arm_timer();
+    }
+    else {
+      deadline_release(task);
+      cbs_release(task);
+      ready_queue_add(task);
+    }
+  }
+  if(ctx == &user_tasks_image.idle_ctx_array[current_cpu()])
+    return sched_choose_next();
+  return sched_maybe_preempt(ctx);
+}
+
+static inline void user_irq_init(void){
+  for(unsigned int i = 0; i < NB_USER_TASKS; i++){
+    unsigned int const irq = user_tasks_image.tasks[i].irq;
+    if(irq == 0) continue;
+    if(user_irq[irq].task != NULL)
+      fatal("Tasks %d and %d are bound to the same IRQ %d\n",
+            context_index(user_irq[irq].task), i, irq);
+    user_irq[irq].task = task_context(i);
+  }
+}
+
+#else
+
+static inline void user_irq_init(void){}
+
+#endif /* USER_INTERRUPTS */
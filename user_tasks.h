@@ -7,6 +7,16 @@
 enum syscalls {
    SYSCALL_YIELD,
    SYSCALL_PUTCHAR,
+#ifdef BASIC_TASKS
+   SYSCALL_JOB_END,
+#endif
+#ifdef MUTEXES
+   SYSCALL_MUTEX_LOCK,
+   SYSCALL_MUTEX_UNLOCK,
+#endif
+#ifdef USER_INTERRUPTS
+   SYSCALL_WAIT_IRQ,
+#endif
    SYSCALL_NUMBER
    /* SYSCALL_SLEEP = 0x33 */
 };
@@ -26,6 +36,49 @@ static inline void putchar(unsigned char x){
   syscall2(SYSCALL_PUTCHAR, x);
 }
 
+#ifdef BASIC_TASKS
+/* End the current job; the next one starts at the entry point. */
+static inline void job_end(void){
+  syscall1(SYSCALL_JOB_END);
+}
+#endif
+
+#ifdef MUTEXES
+/* A mutex is 0 if free; otherwise, it holds the index of its owner
+   plus one, and MUTEX_WAITERS if some tasks are blocked on it. The
+   owner must release it with MUTEX_WAITERS set, so that the kernel
+   hands it to the highest-priority waiter. A task gets its index in
+   eax when it starts. */
+typedef uint32_t mutex_t;
+#define MUTEX_WAITERS 0x80000000U
+
+/* Atomically replace mutex m by new if it is old. */
+static inline _Bool mutex_cas(unsigned int m, mutex_t old, mutex_t new){
+  _Bool ok;
+  asm volatile ("lock cmpxchgl %3, %%gs:(%2)"
+                : "+a"(old), "=@ccz"(ok)
+                : "r"(m * sizeof(mutex_t)), "r"(new)
+                : "memory");
+  return ok;
+}
+
+static inline void mutex_lock(unsigned int m, unsigned int self){
+  if(!mutex_cas(m, 0, self + 1)) syscall2(SYSCALL_MUTEX_LOCK, m);
+}
+
+static inline void mutex_unlock(unsigned int m, unsigned int self){
+  if(!mutex_cas(m, self + 1, 0)) syscall2(SYSCALL_MUTEX_UNLOCK, m);
+}
+#endif
+
+#ifdef USER_INTERRUPTS
+/* Wait for the next interrupt on the IRQ line of the task; the line
+   is masked until then. */
+static inline void wait_irq(void){
+  syscall1(SYSCALL_WAIT_IRQ);
+}
+#endif
+
 #include "lib/fprint.h"
 #define printf(...) fprint(putchar, __VA_ARGS__)
 
@@ -37,6 +90,58 @@ struct task_description {
 #ifdef FP_SCHEDULING     
   unsigned int const priority;
 #endif   
+#ifdef STRIDE_SCHEDULING
+  unsigned int const tickets;   /* Share of the processor. */
+#endif
+#ifdef BASIC_TASKS
+  /* Release of the next job after the end of a job, and deadline of
+     the job relative to its release. */
+  duration_t const period;
+  duration_t const relative_deadline;
+#endif
+#ifdef TIME_PARTITIONING
+  unsigned int const partition;
+#endif
+#ifdef CYCLIC_SCHEDULING
+  duration_t const offset;      /* Release of the first job. */
+#endif
+#ifdef CBS_RESERVATIONS
+  /* The task gets at most cbs_budget every cbs_period; no limit if
+     cbs_budget is 0. */
+  duration_t const cbs_budget;
+  duration_t const cbs_period;
+#endif
+#ifdef USER_INTERRUPTS
+  /* The ISA IRQ line of the task, or 0 (the timer) if none. An
+     interrupt releases a job, at least irq_min_interarrival after the
+     previous one, with a deadline irq_deadline after its release. */
+  unsigned int const irq;
+  duration_t const irq_min_interarrival;
+  duration_t const irq_deadline;
+#endif
+#ifdef USER_IO_PORTS
+  /* The I/O ports that the task can access directly. Tasks can share
+     a list. */
+  uint16_t const *const io_ports;
+  unsigned int const nb_io_ports;
+#endif
+};
+
+/* A window of the major frame, reserved to a partition. The offset is
+   relative to the start of the major frame. */
+struct partition_window {
+  duration_t const offset;
+  duration_t const duration;
+  unsigned int const partition;
+};
+
+/* An entry of the dispatch table of CYCLIC_SCHEDULING: from date
+   (relative to the start of the hyperperiod) to the date of the next
+   entry, context executes, unless it has completed its job. The
+   context is NULL for idle entries. */
+struct dispatch_entry {
+  duration_t const date;
+  struct context * const context;
 };
 
 /* High-level description of the application. */
@@ -47,6 +152,23 @@ extern const struct user_tasks_image {
   struct context ** const ready_heap_array;
   struct context ** const waiting_heap_array;  
   struct context * const idle_ctx_array;
+#ifdef TIME_PARTITIONING
+  unsigned int const nb_partitions;
+  unsigned int const nb_windows;
+  struct partition_window const *const windows;
+  duration_t const major_frame;
+#endif
+#ifdef MUTEXES
+  /* The shared segment. */
+  unsigned int const nb_mutexes;
+  mutex_t * const mutexes;
+#endif
+#ifdef CYCLIC_SCHEDULING
+  /* The table is followed by an entry dated hyperperiod. */
+  unsigned int const nb_dispatch;
+  struct dispatch_entry const *const dispatch_table;
+  duration_t const hyperperiod;
+#endif
 } user_tasks_image;
 
 /* Provided by the application */
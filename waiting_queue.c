@@ -0,0 +1,86 @@
+#include "user_tasks.h"
+#include "high_level.h"
+#include "error.h"
+
+/* The queue of waiting tasks, sorted by their next wakeup date, for
+   use by the schedulers. heap.c must be included before. */
+
+#ifdef WAITING_TIMING_WHEEL
+/* Waiting wheel: the tasks are put in a slot according to their next
+   wakeup tick. */
+#include "timing_wheel.c"
+static struct timing_wheel waiting_wheel;
+
+static inline void waiting_add(struct context *ctx){
+  timing_wheel_insert(&waiting_wheel, ctx);
+}
+
+/* Remove the tasks whose wakeup date is reached, calling f on each. */
+static inline void waiting_wake(date_t curtime, void (*f)(struct context *)){
+  timing_wheel_advance(&waiting_wheel, curtime, f);
+}
+
+/* The date of the nearest non-empty slot. */
+static inline date_t waiting_next_date(void){
+  return timing_wheel_next_date(&waiting_wheel);
+}
+
+static inline void waiting_init(void){
+  timing_wheel_init(&waiting_wheel);
+}
+
+#else
+/* Waiting heap: sort the tasks by their next wakeup date. */
+typedef date_t waiting_priority_t;
+typedef struct context * waiting_elt_id_t;
+static waiting_priority_t waiting_get_priority(waiting_elt_id_t ctx){
+  return ctx->sched_context.wakeup_date;
+}
+/* Earlier wake dates have higher priority. */
+static _Bool waiting_is_gt_priority(date_t a, date_t b){
+  return a < b;
+}
+/* A context is never in both heaps at the same time, so they can
+   share the index. */
+static void waiting_set_index(waiting_elt_id_t ctx, unsigned int index){
+  ctx->sched_context.heap_index = index;
+}
+static unsigned int waiting_get_index(waiting_elt_id_t ctx){
+  return ctx->sched_context.heap_index;
+}
+#ifdef HEAP_ARITY
+INSTANTIATE_DARY_HEAP(waiting, HEAP_ARITY);
+_Static_assert(sizeof(struct waiting_heap_entry) <= HEAP_ENTRY_MAX, "See HEAP_STORAGE");
+/* Defined by HIGH_LEVEL_SYSTEM_DESC. */
+extern char waiting_heap_storage[];
+#else
+INSTANTIATE_HEAP(waiting);
+#endif
+static struct waiting_heap waiting_heap;
+
+static inline void waiting_add(struct context *ctx){
+  assert(waiting_heap.size <= NB_USER_TASKS);
+  waiting_insert_elt(&waiting_heap, ctx);
+}
+
+/* Remove the tasks whose wakeup date is reached, calling f on each. */
+static inline void waiting_wake(date_t curtime, void (*f)(struct context *)){
+  waiting_remove_up_to(&waiting_heap, curtime, f);
+}
+
+/* The date of the next wakeup. */
+static inline date_t waiting_next_date(void){
+  if(waiting_heap.size == 0) return DATE_FAR_AWAY;
+  return waiting_top_priority(&waiting_heap);
+}
+
+static inline void waiting_init(void){
+  waiting_heap.size = 0;
+  waiting_heap.capacity = NB_USER_TASKS;
+#ifdef HEAP_ARITY
+  waiting_heap.array = DARY_HEAP_ARRAY_IN(waiting, waiting_heap_storage);
+#else
+  waiting_heap.array = user_tasks_image.waiting_heap_array;
+#endif
+}
+#endif /* WAITING_TIMING_WHEEL */
@@ -0,0 +1,67 @@
+#ifndef __X86_ACPI_H__
+#define __X86_ACPI_H__
+
+/* Lookup of the ACPI tables describing the hardware. The kernel data
+   segment is flat and there is no paging, so they are read at their
+   physical address. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct acpi_header {
+  char signature[4];
+  uint32_t length;
+  uint8_t revision;
+  uint8_t checksum;
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} __attribute__((packed));
+
+static inline _Bool acpi_checksum_ok(void const *p, uint32_t length){
+  uint8_t sum = 0;
+  for(uint32_t i = 0; i < length; i++) sum += ((uint8_t const *) p)[i];
+  return sum == 0;
+}
+
+static inline _Bool acpi_signature_is(char const *s, char const *sig, unsigned int n){
+  for(unsigned int i = 0; i < n; i++) if(s[i] != sig[i]) return 0;
+  return 1;
+}
+
+/* The RSDP is on a 16-byte boundary, in the first KiB of the EBDA or
+   in the BIOS area. Return the address of the RSDT, or 0. */
+static inline uint32_t acpi_find_rsdt(void){
+  /* The segment of the EBDA is in the BIOS data area. The compiler
+     must not see this address as a constant. */
+  uint16_t const *bda_ebda = (uint16_t const *) 0x40E;
+  asm("" : "+r"(bda_ebda));
+  uint32_t const ebda = (uint32_t) *bda_ebda << 4;
+  uint32_t const ranges[2][2] = { { ebda, ebda + 1024 }, { 0xE0000, 0x100000 } };
+  for(unsigned int r = 0; r < 2; r++)
+    for(uint32_t a = ranges[r][0]; a < ranges[r][1]; a += 16){
+      char const *p = (char const *) a;
+      if(acpi_signature_is(p, "RSD PTR ", 8) && acpi_checksum_ok(p, 20))
+        return *(uint32_t const *) (p + 16);
+    }
+  return 0;
+}
+
+/* The table with this signature, or NULL. */
+static inline struct acpi_header const *acpi_find_table(char const *signature){
+  uint32_t const rsdt_address = acpi_find_rsdt();
+  if(rsdt_address == 0) return NULL;
+  struct acpi_header const *rsdt = (struct acpi_header const *) rsdt_address;
+  uint32_t const *entries = (uint32_t const *) (rsdt + 1);
+  unsigned int const n = (rsdt->length - sizeof(*rsdt)) / sizeof(uint32_t);
+  for(unsigned int i = 0; i < n; i++){
+    struct acpi_header const *t = (struct acpi_header const *) entries[i];
+    if(acpi_signature_is(t->signature, signature, 4) && acpi_checksum_ok(t, t->length))
+      return t;
+  }
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __X86_APIC_H__
+#define __X86_APIC_H__
+
+/* The local APIC, accessed through its memory-mapped registers. The
+   kernel data segment is flat, so they are at their physical
+   address. */
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80          /* Task priority. */
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0          /* Spurious interrupt vector. */
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL_COUNT 0x380
+#define LAPIC_TIMER_CURRENT_COUNT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_LVT_MASKED (1 << 16)
+#define LAPIC_TIMER_ONE_SHOT (0 << 17)
+#define LAPIC_TIMER_TSC_DEADLINE (2 << 17)
+
+#define CPUID_1_EDX_TSC (1 << 4)
+#define CPUID_1_EDX_APIC (1 << 9)
+#define CPUID_1_ECX_TSC_DEADLINE (1 << 24)
+#define CPUID_80000007_EDX_INVARIANT_TSC (1 << 8)
+
+extern volatile uint32_t *lapic;
+
+static inline uint32_t lapic_read(unsigned int reg){
+  return lapic[reg / 4];
+}
+
+static inline void lapic_write(unsigned int reg, uint32_t val){
+  lapic[reg / 4] = val;
+}
+
+static inline uint8_t lapic_id(void){
+  return lapic_read(LAPIC_ID) >> 24;
+}
+
+/* A single memory write. */
+static inline void lapic_eoi(void){
+  lapic_write(LAPIC_EOI, 0);
+}
+
+/* Enable the local APIC of the current CPU; spurious interrupts go
+   to spurious_vector. The task priority stays the lowest, so that all
+   the interrupts are accepted: the kernel enters through interrupt
+   gates, and so never runs with interrupts enabled but when idle, and
+   the ISA vectors are all in the same priority class (the high 4
+   bits), so the TPR could not hold back some of them without the
+   timer. */
+static inline void lapic_enable(uint8_t spurious_vector){
+  uint64_t const base = rdmsr(MSR_IA32_APIC_BASE);
+  wrmsr(MSR_IA32_APIC_BASE, base | (1 << 11));
+  lapic = (volatile uint32_t *) (uint32_t) (base & 0xFFFFF000);
+  lapic_write(LAPIC_SVR, (1 << 8) | spurious_vector);
+  lapic_write(LAPIC_TPR, 0);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __X86_CPU_H__
+#define __X86_CPU_H__
+
+#include <stdint.h>
+
+struct cpuid { uint32_t eax, ebx, ecx, edx; };
+
+static inline struct cpuid cpuid(uint32_t leaf){
+  struct cpuid r;
+  asm volatile ("cpuid"
+                : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx)
+                : "a"(leaf), "c"(0));
+  return r;
+}
+
+static inline uint64_t rdmsr(uint32_t msr){
+  uint64_t ret;
+  asm volatile ("rdmsr" : "=A"(ret) : "c"(msr));
+  return ret;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val){
+  asm volatile ("wrmsr" : : "c"(msr), "A"(val) : "memory");
+}
+
+static inline uint64_t rdtsc(void){
+  uint64_t ret;
+  asm volatile ("rdtsc" : "=A"(ret));
+  return ret;
+}
+
+static inline uint32_t read_cr0(void){
+  uint32_t ret;
+  asm volatile ("mov %%cr0, %0" : "=r"(ret));
+  return ret;
+}
+
+static inline void write_cr0(uint32_t val){
+  asm volatile ("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr4(void){
+  uint32_t ret;
+  asm volatile ("mov %%cr4, %0" : "=r"(ret));
+  return ret;
+}
+
+static inline void write_cr4(uint32_t val){
+  asm volatile ("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+/* Clear CR0.TS. */
+static inline void clts(void){
+  asm volatile ("clts" : : : "memory");
+}
+
+/* The area must be 512 bytes, aligned on 16. */
+static inline void fxsave(void *area){
+  asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(void const *area){
+  asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+#define MSR_IA32_APIC_BASE 0x1B
+#define MSR_IA32_TSC_DEADLINE 0x6E0
+#define MSR_IA32_SYSENTER_CS 0x174
+#define MSR_IA32_SYSENTER_ESP 0x175
+#define MSR_IA32_SYSENTER_EIP 0x176
+
+#define CPUID_1_EDX_SEP (1 << 11)
+#define CPUID_1_EDX_FXSR (1 << 24)
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __X86_IOAPIC_H__
+#define __X86_IOAPIC_H__
+
+/* The IOAPIC, which routes the external interrupts to the local
+   APICs. Only the first one described in the MADT is used. */
+
+#include <stdint.h>
+#include "acpi.h"
+#include "apic.h"
+
+extern volatile uint32_t *ioapic;
+
+/* The pin and redirection of the ISA IRQs that are routed. */
+struct ioapic_isa_route { uint8_t pin; uint32_t redirection; };
+extern struct ioapic_isa_route ioapic_isa_routes[16];
+
+static inline void ioapic_write(unsigned int reg, uint32_t val){
+  ioapic[0] = reg;              /* IOREGSEL */
+  ioapic[4] = val;              /* IOWIN */
+}
+
+#define IOAPIC_REDIRECTION(pin) (0x10 + 2 * (pin))
+#define IOAPIC_ACTIVE_LOW (1 << 13)
+#define IOAPIC_LEVEL_TRIGGERED (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+struct madt {
+  struct acpi_header header;
+  uint32_t lapic_address;
+  uint32_t flags;
+  uint8_t entries[];
+} __attribute__((packed));
+
+#define MADT_IOAPIC 1
+#define MADT_INTERRUPT_SOURCE_OVERRIDE 2
+
+/* Route the ISA irq to vector, on the current CPU, masked or not. The
+   MADT tells which pin it is connected to, and its polarity and
+   trigger mode. Return false if there is no IOAPIC. */
+static inline _Bool ioapic_route_isa_irq(unsigned int irq, uint8_t vector, _Bool masked){
+  struct madt const *madt = (struct madt const *) acpi_find_table("APIC");
+  if(madt == NULL) return 0;
+  uint32_t gsi = irq, gsi_base = 0;
+  uint16_t flags = 0;           /* ISA: edge-triggered, active high. */
+  ioapic = NULL;
+  uint8_t const *end = (uint8_t const *) madt + madt->header.length;
+  for(uint8_t const *e = madt->entries; e < end && e[1] != 0; e += e[1]){
+    if(e[0] == MADT_IOAPIC && ioapic == NULL){
+      ioapic = (volatile uint32_t *) *(uint32_t const *) (e + 4);
+      gsi_base = *(uint32_t const *) (e + 8);
+    }
+    else if(e[0] == MADT_INTERRUPT_SOURCE_OVERRIDE && e[2] == 0 && e[3] == irq){
+      gsi = *(uint32_t const *) (e + 4);
+      flags = *(uint16_t const *) (e + 8);
+    }
+  }
+  if(ioapic == NULL) return 0;
+  uint32_t low = vector;        /* Fixed delivery, physical destination. */
+  if((flags & 3) == 3) low |= IOAPIC_ACTIVE_LOW;
+  if(((flags >> 2) & 3) == 3) low |= IOAPIC_LEVEL_TRIGGERED;
+  unsigned int const pin = gsi - gsi_base;
+  ioapic_isa_routes[irq] = (struct ioapic_isa_route){ .pin = pin, .redirection = low };
+  ioapic_write(IOAPIC_REDIRECTION(pin) + 1, (uint32_t) lapic_id() << 24);
+  ioapic_write(IOAPIC_REDIRECTION(pin), masked ? low | IOAPIC_MASKED : low);
+  return 1;
+}
+
+/* Once routed. */
+static inline void ioapic_set_masked(unsigned int irq, _Bool masked){
+  struct ioapic_isa_route const r = ioapic_isa_routes[irq];
+  ioapic_write(IOAPIC_REDIRECTION(r.pin),
+               masked ? r.redirection | IOAPIC_MASKED : r.redirection);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __X86_IRQ_H__
+#define __X86_IRQ_H__
+
+/* The delivery of the ISA IRQs, as vectors from TIMER_INTERRUPT_NUMBER.
+   By default, they go through the 8259. With IOAPIC_INTERRUPTS, the
+   8259 is masked, they are routed by the IOAPIC to the local APIC,
+   and acknowledged with a memory write instead of a port I/O. */
+
+#include <stdint.h>
+#include "../config.h"
+#include "../low_level.h"
+#include "../error.h"
+#include "pic.h"
+#include "apic.h"
+#include "ioapic.h"
+
+/* Enable the ISA IRQs whose bit is set. */
+static inline void isa_irq_init(uint16_t enabled){
+#ifdef IOAPIC_INTERRUPTS
+  pic_init(TIMER_INTERRUPT_NUMBER, SPURIOUS_TIMER_INTERRUPT_NUMBER, 0xFF, 0xFF);
+  lapic_enable(APIC_SPURIOUS_INTERRUPT_NUMBER);
+  for(unsigned int irq = 0; irq < 16; irq++)
+    if((enabled & (1 << irq))
+       && !ioapic_route_isa_irq(irq, TIMER_INTERRUPT_NUMBER + irq, 0))
+      fatal("No IOAPIC\n");
+#else
+  /* The slave is cascaded on IRQ2. */
+  if(enabled & 0xFF00) enabled |= 1 << 2;
+  pic_init(TIMER_INTERRUPT_NUMBER, SPURIOUS_TIMER_INTERRUPT_NUMBER,
+           ~enabled & 0xFF, (~enabled >> 8) & 0xFF);
+#endif
+}
+
+/* Route an ISA IRQ after isa_irq_init, masked. */
+static inline void isa_irq_route(unsigned int irq){
+#ifdef IOAPIC_INTERRUPTS
+  if(!ioapic_route_isa_irq(irq, TIMER_INTERRUPT_NUMBER + irq, 1))
+    fatal("No IOAPIC\n");
+#else
+  uint16_t const port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+  outb(port, inb(port) | (1 << (irq & 7)));
+  /* The slave is cascaded on IRQ2. */
+  if(irq >= 8) outb(PIC_MASTER_DATA, inb(PIC_MASTER_DATA) & ~(1 << 2));
+#endif
+}
+
+static inline void isa_irq_set_masked(unsigned int irq, _Bool masked){
+#ifdef IOAPIC_INTERRUPTS
+  ioapic_set_masked(irq, masked);
+#else
+  uint16_t const port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+  uint8_t const bit = 1 << (irq & 7);
+  uint8_t const mask = inb(port);
+  outb(port, masked ? mask | bit : mask & ~bit);
+#endif
+}
+
+/* Acknowledge an ISA IRQ. */
+static inline void isa_irq_eoi(unsigned int irq){
+#ifdef IOAPIC_INTERRUPTS
+  (void) irq;
+  lapic_eoi();
+#else
+  if(irq >= 8) outb(PIC_SLAVE_COMMAND, 0x20);
+  pic_eoi();
+#endif
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __X86_PIC_H__
+#define __X86_PIC_H__
+
+/* The legacy 8259 interrupt controllers. https://wiki.osdev.org/8259_PIC */
+
+#include <stdint.h>
+#include "port.h"
+
+#define PIC_MASTER_COMMAND 0x20
+#define PIC_MASTER_DATA 0x21
+#define PIC_SLAVE_COMMAND 0xA0
+#define PIC_SLAVE_DATA 0xA1
+
+/* Map the IRQs of the master and slave PICs from master_vector and
+   slave_vector, and mask those whose bit is set in the masks. */
+static inline void pic_init(uint8_t master_vector, uint8_t slave_vector,
+                            uint8_t master_mask, uint8_t slave_mask){
+  /* Initialize. Wait for three words on the data port.*/
+  outb(PIC_MASTER_COMMAND, 0x11);
+  outb(PIC_SLAVE_COMMAND, 0x11);
+
+  /* Change the interrupt number from defaults 0x08 and 0x70. */
+  outb(PIC_MASTER_DATA, master_vector);
+  outb(PIC_SLAVE_DATA, slave_vector);
+
+  /* Connect master and slave PIC. */
+  outb(PIC_MASTER_DATA, 4);
+  outb(PIC_SLAVE_DATA, 2);
+
+  /* Require explicit end of interrupt. */
+  outb(PIC_MASTER_DATA, 1);
+  outb(PIC_SLAVE_DATA, 1);
+
+  outb(PIC_MASTER_DATA, master_mask);
+  outb(PIC_SLAVE_DATA, slave_mask);
+}
+
+/* Acknowledge an IRQ of the master PIC. */
+static inline void pic_eoi(void){
+  outb(PIC_MASTER_COMMAND, 0x20);
+}
+
+#endif